@@ -12,11 +12,14 @@
 #include <concepts>
 #include <coroutine>
 #include <exception>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <optional>
 #include <queue>
 #include <semaphore>
 #include <thread>
+#include <utility>
 
 using namespace std::chrono_literals;
 
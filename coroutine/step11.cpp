@@ -0,0 +1,425 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 09:12:31
+ *
+ * File Name: step11.cpp
+ * Description:
+ *
+ *  Step 11: Let the caller decide where the coroutine frame of step 9 lives
+ *  - Pass `std::allocator_arg, alloc` as the leading coroutine parameters
+ *  - The allocator is stored behind the frame, so deallocation uses the same allocator
+ *
+ */
+
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <optional>
+
+//
+// Count the global allocations, so we could see whether the frame is allocated on heap or not
+//
+
+static size_t global_new_calls = 0;
+
+void* operator new(std::size_t size) {
+  ++global_new_calls;
+  if (void* ptr = std::malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+// The array and aligned forms, so all of the global allocations are counted and freed by the matching function
+
+void* operator new[](std::size_t size) { return ::operator new(size); }
+
+void operator delete[](void* ptr) noexcept { ::operator delete(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { ::operator delete(ptr); }
+
+void* operator new(std::size_t size, std::align_val_t align) {
+  ++global_new_calls;
+  // aligned_alloc requires the size to be a multiple of the alignment
+  auto alignment = static_cast<std::size_t>(align);
+  if (void* ptr = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) { return ::operator new(size, align); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+
+//
+// The frame allocator.
+//
+//  The layout of an allocated block:
+//
+//    | coroutine frame (size bytes) | deallocate function pointer | allocator |
+//
+//  The compiler tells us the frame size in operator delete, so we could find the trailer and the allocator which
+//  allocated the block without knowing the allocator type.
+//
+class frame_allocator {
+ public:
+  template <typename Alloc>
+  static void* allocate(const Alloc& alloc, std::size_t size) {
+    using block_allocator = typename std::allocator_traits<Alloc>::template rebind_alloc<block>;
+    block_allocator block_alloc(alloc);
+    auto ptr = std::allocator_traits<block_allocator>::allocate(block_alloc, blocks<block_allocator>(size));
+    auto frame = static_cast<void*>(ptr);
+    // Store the deallocate function and the allocator behind the frame
+    ::new (dealloc_address(frame, size)) dealloc_function(&deallocate<block_allocator>);
+    ::new (alloc_address<block_allocator>(frame, size)) block_allocator(std::move(block_alloc));
+    return frame;
+  }
+
+  static void deallocate(void* frame, std::size_t size) {
+    auto dealloc = *static_cast<dealloc_function*>(dealloc_address(frame, size));
+    dealloc(frame, size);
+  }
+
+ private:
+  struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) block {
+    std::byte bytes[__STDCPP_DEFAULT_NEW_ALIGNMENT__];
+  };
+
+  using dealloc_function = void (*)(void*, std::size_t);
+
+  static constexpr std::size_t align_up(std::size_t size, std::size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  static constexpr std::size_t dealloc_offset(std::size_t size) { return align_up(size, alignof(dealloc_function)); }
+
+  template <typename BlockAllocator>
+  static constexpr std::size_t alloc_offset(std::size_t size) {
+    return align_up(dealloc_offset(size) + sizeof(dealloc_function), alignof(BlockAllocator));
+  }
+
+  template <typename BlockAllocator>
+  static constexpr std::size_t blocks(std::size_t size) {
+    return (alloc_offset<BlockAllocator>(size) + sizeof(BlockAllocator) + sizeof(block) - 1) / sizeof(block);
+  }
+
+  static void* dealloc_address(void* frame, std::size_t size) {
+    return static_cast<std::byte*>(frame) + dealloc_offset(size);
+  }
+
+  template <typename BlockAllocator>
+  static void* alloc_address(void* frame, std::size_t size) {
+    return static_cast<std::byte*>(frame) + alloc_offset<BlockAllocator>(size);
+  }
+
+  template <typename BlockAllocator>
+  static void deallocate(void* frame, std::size_t size) {
+    auto p_alloc = static_cast<BlockAllocator*>(alloc_address<BlockAllocator>(frame, size));
+    // Move the allocator out before releasing the memory it lives in
+    BlockAllocator alloc(std::move(*p_alloc));
+    p_alloc->~BlockAllocator();
+    std::allocator_traits<BlockAllocator>::deallocate(alloc, static_cast<block*>(frame), blocks<BlockAllocator>(size));
+  }
+};
+
+template <typename ReturnType, typename SendType, SendType DEFAULT_SEND_VALUE>
+class Generator {
+ public:
+  //
+  // Promise
+  //
+  class promise_type {
+   public:
+    //
+    // Frame allocation. The compiler passes the coroutine arguments to operator new when there's a matched overload,
+    // otherwise it falls back to operator new(size).
+    //
+    static void* operator new(std::size_t size) { return frame_allocator::allocate(std::allocator<std::byte>(), size); }
+
+    template <typename Alloc, typename... Args>
+    static void* operator new(std::size_t size, std::allocator_arg_t, const Alloc& alloc, const Args&...) {
+      return frame_allocator::allocate(alloc, size);
+    }
+
+    static void operator delete(void* ptr, std::size_t size) { frame_allocator::deallocate(ptr, size); }
+
+    Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    template <std::convertible_to<ReturnType> From>  // C++20 concept
+    auto yield_value(From&& value) {
+      return_value_ = std::forward<From>(value);
+
+      struct send_awaiter {
+        std::coroutine_handle<promise_type> handle_;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) {}
+        const SendType& await_resume() const noexcept {
+          // Return the send value
+          return handle_.promise().send_value_;
+        }
+      };
+
+      return send_awaiter{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+
+    SendType send_value_;
+    ReturnType return_value_;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = ReturnType;
+    using reference = ReturnType&;
+    using pointer = ReturnType*;
+
+    template <typename T>
+    iterator(Generator& gen, T&& send_value) noexcept : gen_(gen), send_value_(std::forward<T>(send_value)) {
+      operator++();  // Initial read
+    }
+    iterator(const iterator&) = default;
+    ~iterator() = default;
+
+    friend bool operator==(const iterator& it, sentinel) noexcept {
+      // The iterator stopped when generator is done
+      return it.gen_.Done();
+    }
+
+    iterator& operator++() {
+      gen_.Next(send_value_);
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    reference operator*() const { return gen_.Get(); }
+
+   private:
+    Generator& gen_;
+    SendType send_value_;
+  };
+
+  //
+  // Generator
+  //
+
+  Generator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  ~Generator() { handle_.destroy(); }
+
+  explicit operator bool() const noexcept { return !handle_.done() && !consumed_; }
+
+  ReturnType& Get() {
+    consumed_ = true;
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+    return *value_;
+  }
+
+  bool Next() { return Next(DEFAULT_SEND_VALUE); }
+
+  template <typename T>
+  bool Next(T&& send_value) {
+    if (!handle_.done()) {
+      handle_.promise().send_value_ = std::forward<T>(send_value);
+      handle_();
+      if (exception_ = handle_.promise().exception_; exception_) {
+        // Has exception, and should return true as if there's new value (To let the exception rethrow by Get)
+        consumed_ = false;
+        value_ = {};
+        return true;
+      } else if (handle_.done()) {
+        // The final suspend, no more to read
+        consumed_ = true;
+        value_ = {};
+        return false;
+      } else {
+        // Has new value
+        consumed_ = false;
+        value_ = std::move(handle_.promise().return_value_);  // Move the value out of promise
+        return true;
+      }
+    } else {
+      // Done, no more to read
+      consumed_ = true;
+      value_ = {};
+      return false;
+    }
+  }
+
+  bool Done() const { return handle_.done(); }
+
+  iterator begin() { return begin(DEFAULT_SEND_VALUE); }
+
+  iterator begin(SendType&& send_value) {
+    // Create iterator by custom send value
+    return iterator(*this, std::forward<SendType>(send_value));
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+  bool consumed_ = true;
+  std::optional<ReturnType> value_;
+  std::exception_ptr exception_;
+};
+
+//
+// A bump allocator over a caller owned buffer (e.g. a buffer on stack). Deallocate does nothing, the memory is
+// released as a whole when the arena goes away.
+//
+
+class Arena {
+ public:
+  Arena(void* buffer, size_t size) : begin_(static_cast<std::byte*>(buffer)), end_(begin_ + size), top_(begin_) {}
+
+  void* allocate(size_t size, size_t alignment) {
+    void* ptr = top_;
+    size_t space = end_ - top_;
+    if (!std::align(alignment, size, ptr, space)) {
+      throw std::bad_alloc();
+    }
+    top_ = static_cast<std::byte*>(ptr) + size;
+    return ptr;
+  }
+
+  size_t used() const noexcept { return top_ - begin_; }
+
+ private:
+  std::byte* begin_;
+  std::byte* end_;
+  std::byte* top_;
+};
+
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  ArenaAllocator(Arena& arena) noexcept : arena_(&arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena_) {}
+
+  T* allocate(size_t n) { return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T))); }
+
+  void deallocate(T*, size_t) noexcept {}
+
+  template <typename U>
+  friend bool operator==(const ArenaAllocator& a, const ArenaAllocator<U>& b) noexcept {
+    return a.arena_ == b.arena_;
+  }
+
+ private:
+  template <typename U>
+  friend class ArenaAllocator;
+
+  Arena* arena_;
+};
+
+//
+// The real logic. The only difference is the two leading arguments.
+//
+
+template <size_t STEP = 1>
+Generator<size_t, size_t, STEP> counter(size_t max) {
+  for (size_t i = 0; i < max;) {
+    auto step = co_yield i;
+    i += step;
+  }
+}
+
+// A coroutine frame is always freed by the usual operator delete(void*, size), gcc takes it as a mismatch of the
+// operator new with the allocator arguments
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+template <size_t STEP = 1, typename Alloc>
+Generator<size_t, size_t, STEP> counter(std::allocator_arg_t, const Alloc&, size_t max) {
+  for (size_t i = 0; i < max;) {
+    auto step = co_yield i;
+    i += step;
+  }
+}
+#pragma GCC diagnostic pop
+
+// Run the generator and return how many times the global operator new is called
+template <typename Gen>
+size_t count_new_calls(Gen&& make_gen, size_t& sum) {
+  auto calls = global_new_calls;
+  {
+    auto gen = make_gen();
+    for (const auto value : gen) {
+      sum += value;
+    }
+  }
+  return global_new_calls - calls;
+}
+
+int main() {
+  size_t sum = 0;
+  bool ok = true;
+  //
+  // Usage 1: Default, the frame is allocated by global operator new
+  //
+  auto calls = count_new_calls([] { return counter(3); }, sum);
+  std::cout << "[+] Usage1 (default) new calls:" << calls << std::endl;
+  ok = ok && calls == 1;
+  //
+  // Usage 2: The arena on stack
+  //
+  alignas(std::max_align_t) std::byte buffer[1024];
+  Arena arena(buffer, sizeof(buffer));
+  calls = count_new_calls([&arena] { return counter(std::allocator_arg, ArenaAllocator<std::byte>(arena), 3); }, sum);
+  std::cout << "[+] Usage2 (arena) new calls:" << calls << " arena used:" << (arena.used() > 0) << std::endl;
+  ok = ok && calls == 0 && arena.used() > 0;
+  //
+  // Usage 3: The monotonic buffer resource on stack, and never fall back to heap
+  //
+  std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+  calls = count_new_calls(
+      [&resource] { return counter(std::allocator_arg, std::pmr::polymorphic_allocator<>(&resource), 3); }, sum);
+  std::cout << "[+] Usage3 (monotonic_buffer_resource) new calls:" << calls << std::endl;
+  ok = ok && calls == 0;
+
+  std::cout << "sum:" << sum << " " << (ok ? "OK" : "FAILED") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs:
+[+] Usage1 (default) new calls:1
+[+] Usage2 (arena) new calls:0 arena used:1
+[+] Usage3 (monotonic_buffer_resource) new calls:0
+sum:9 OK
+*/
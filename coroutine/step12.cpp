@@ -0,0 +1,311 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 10:03:47
+ *
+ * File Name: step12.cpp
+ * Description:
+ *
+ *  Step 12: Yield by reference
+ *  - In step 9 each value is stored twice: into the promise by yield_value and then into the generator by Next.
+ *  - Here the promise only stores a pointer to the yielded object. The object lives in the suspended coroutine frame
+ *    (a local variable, or a temporary which lives until the end of the co_yield full expression), so the consumer
+ *    could read it in place. The value type doesn't have to be default constructible any more.
+ *
+ */
+
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <typename T>
+class Generator {
+ public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = const value_type&;
+  using pointer = const value_type*;
+
+  //
+  // Promise
+  //
+  class promise_type {
+   public:
+    Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    // Both lvalues and temporaries bind here. A temporary is not destroyed until the coroutine resumes from this
+    // co_yield, so it's safe to keep the address.
+    std::suspend_always yield_value(reference value) noexcept {
+      value_ = std::addressof(value);
+      return {};
+    }
+
+    // Values of other types are converted into the awaiter, which also lives in the frame during the suspension.
+    template <typename From>
+      requires(std::convertible_to<From, value_type> && !std::same_as<std::remove_cvref_t<From>, value_type>)
+    auto yield_value(From&& from) {
+      struct convert_awaiter {
+        value_type value_;
+        promise_type& promise_;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) noexcept { promise_.value_ = std::addressof(value_); }
+        constexpr void await_resume() const noexcept {}
+      };
+
+      return convert_awaiter{value_type(std::forward<From>(from)), *this};
+    }
+
+    pointer value_ = nullptr;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+    using reference = Generator::reference;
+    using pointer = Generator::pointer;
+
+    explicit iterator(Generator& gen) noexcept : gen_(gen) {}
+
+    friend bool operator==(const iterator& it, sentinel) noexcept { return it.gen_.Done(); }
+
+    iterator& operator++() {
+      gen_.Next();
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    // Read the value in place, there's no copy at all
+    reference operator*() const { return *gen_.handle_.promise().value_; }
+
+    pointer operator->() const { return gen_.handle_.promise().value_; }
+
+   private:
+    Generator& gen_;
+  };
+
+  //
+  // Generator
+  //
+
+  explicit Generator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Generator(const Generator&) = delete;
+
+  ~Generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool Next() {
+    if (handle_.done()) {
+      return false;
+    }
+    handle_();
+    if (auto exception = std::exchange(handle_.promise().exception_, {}); exception) {
+      std::rethrow_exception(exception);
+    }
+    return !handle_.done();
+  }
+
+  // Only valid after Next() returns true, and until the next call of Next()
+  reference Get() const { return *handle_.promise().value_; }
+
+  bool Done() const { return handle_.done(); }
+
+  iterator begin() {
+    Next();  // Initial read
+    return iterator(*this);
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// The generator of step 9 (without send), which stores the value twice, for comparison.
+//
+
+template <typename T>
+class CopyGenerator {
+ public:
+  class promise_type {
+   public:
+    CopyGenerator get_return_object() {
+      return CopyGenerator(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    template <std::convertible_to<T> From>
+    std::suspend_always yield_value(From&& value) {
+      return_value_ = std::forward<From>(value);
+      return {};
+    }
+
+    T return_value_;
+    std::exception_ptr exception_;
+  };
+
+  explicit CopyGenerator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  ~CopyGenerator() { handle_.destroy(); }
+
+  bool Next() {
+    handle_();
+    if (handle_.promise().exception_) {
+      std::rethrow_exception(handle_.promise().exception_);
+    }
+    if (handle_.done()) {
+      value_ = {};
+      return false;
+    }
+    value_ = std::move(handle_.promise().return_value_);  // Move the value out of promise
+    return true;
+  }
+
+  const T& Get() const { return *value_; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+  std::optional<T> value_;
+};
+
+//
+// Values
+//
+
+// A 4KB record, e.g. a parsed row
+struct Record {
+  size_t id;
+  char payload[4096 - sizeof(size_t)];
+};
+
+// A type without default constructor, which cannot be used by the generators of step 8 and step 9
+struct Point {
+  Point(int x, int y) : x(x), y(y) {}
+  int x, y;
+};
+
+//
+// The real logic
+//
+
+Generator<Record> records(size_t num) {
+  Record record;
+  std::memset(record.payload, 'x', sizeof(record.payload));
+  for (size_t i = 0; i < num; ++i) {
+    record.id = i;
+    record.payload[i % sizeof(record.payload)] = static_cast<char>(i);
+    co_yield record;  // Yield by reference, no copy
+  }
+}
+
+CopyGenerator<Record> copy_records(size_t num) {
+  Record record;
+  std::memset(record.payload, 'x', sizeof(record.payload));
+  for (size_t i = 0; i < num; ++i) {
+    record.id = i;
+    record.payload[i % sizeof(record.payload)] = static_cast<char>(i);
+    co_yield record;  // Copy into promise, then move into generator
+  }
+}
+
+Generator<Point> points(int num) {
+  for (int i = 0; i < num; ++i) {
+    co_yield Point(i, i * i);  // A temporary
+  }
+}
+
+Generator<double> halves(int num) {
+  for (int i = 0; i < num; ++i) {
+    co_yield i;  // Converted from int
+  }
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage 1: Temporaries of a type without default constructor
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  for (const auto& point : points(3)) {
+    std::cout << "main:" << point.x << "," << point.y << std::endl;
+  }
+  //
+  // Usage 2: Converted values
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  for (auto value : halves(3)) {
+    std::cout << "main:" << value / 2 << std::endl;
+  }
+  //
+  // Benchmark: 4KB records
+  //
+  constexpr size_t num = 500000;
+  size_t checksum1 = 0, checksum2 = 0;
+  auto copy_ms = measure([&checksum1] {
+    auto gen = copy_records(num);
+    while (gen.Next()) {
+      const auto& record = gen.Get();
+      checksum1 += record.id + record.payload[record.id % sizeof(record.payload)];
+    }
+  });
+  auto ref_ms = measure([&checksum2] {
+    for (const auto& record : records(num)) {
+      checksum2 += record.id + record.payload[record.id % sizeof(record.payload)];
+    }
+  });
+  std::cout << "[+] Benchmark: " << num << " records of " << sizeof(Record) << " bytes" << std::endl;
+  std::cout << "copy:" << copy_ms << "ms (" << copy_ms * 1e6 / num << "ns/record)" << std::endl;
+  std::cout << "reference:" << ref_ms << "ms (" << ref_ms * 1e6 / num << "ns/record)" << std::endl;
+  std::cout << "checksum:" << (checksum1 == checksum2 ? "match" : "mismatch") << std::endl;
+  return checksum1 == checksum2 ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage1
+main:0,0
+main:1,1
+main:2,4
+[+] Usage2
+main:0
+main:0.5
+main:1
+[+] Benchmark: 500000 records of 4096 bytes
+copy:41.2ms (82.4ns/record)
+reference:1.8ms (3.6ns/record)
+checksum:match
+*/
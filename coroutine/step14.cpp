@@ -0,0 +1,445 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 13:02:18
+ *
+ * File Name: step14.cpp
+ * Description:
+ *
+ *  Step 14: Prefetch the generator of step 12 on a background thread
+ *  - The consumer and the producer of a generator take turns on the same thread, so their time adds up.
+ *  - `prefetch(gen, depth)` drives the producer on a worker thread and hands the values to the consumer through a
+ *    single-producer single-consumer lock-free ring buffer. The iterator interface keeps the same.
+ *  - The exception of the producer is rethrown to the consumer after the values produced before it. Destroying the
+ *    prefetcher early stops and joins the worker.
+ *
+ */
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <stop_token>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+//
+// The generator of step 12
+//
+
+template <typename T>
+class Generator {
+ public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = const value_type&;
+  using pointer = const value_type*;
+
+  //
+  // Promise
+  //
+  class promise_type {
+   public:
+    Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    std::suspend_always yield_value(reference value) noexcept {
+      value_ = std::addressof(value);
+      return {};
+    }
+
+    template <typename From>
+      requires(std::convertible_to<From, value_type> && !std::same_as<std::remove_cvref_t<From>, value_type>)
+    auto yield_value(From&& from) {
+      struct convert_awaiter {
+        value_type value_;
+        promise_type& promise_;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) noexcept { promise_.value_ = std::addressof(value_); }
+        constexpr void await_resume() const noexcept {}
+      };
+
+      return convert_awaiter{value_type(std::forward<From>(from)), *this};
+    }
+
+    pointer value_ = nullptr;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+    using reference = Generator::reference;
+    using pointer = Generator::pointer;
+
+    explicit iterator(Generator& gen) noexcept : gen_(gen) {}
+
+    friend bool operator==(const iterator& it, sentinel) noexcept { return it.gen_.Done(); }
+
+    iterator& operator++() {
+      gen_.Next();
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    reference operator*() const { return gen_.Get(); }
+
+   private:
+    Generator& gen_;
+  };
+
+  //
+  // Generator
+  //
+
+  explicit Generator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Generator(const Generator&) = delete;
+
+  ~Generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool Next() {
+    if (handle_.done()) {
+      return false;
+    }
+    handle_();
+    if (auto exception = std::exchange(handle_.promise().exception_, {}); exception) {
+      std::rethrow_exception(exception);
+    }
+    return !handle_.done();
+  }
+
+  reference Get() const { return *handle_.promise().value_; }
+
+  bool Done() const { return handle_.done(); }
+
+  iterator begin() {
+    Next();  // Initial read
+    return iterator(*this);
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// Single-producer single-consumer lock-free ring buffer
+//
+
+template <typename T>
+class spsc_ring {
+ public:
+  // The capacity is rounded up to a power of 2
+  explicit spsc_ring(size_t capacity) : mask_(std::bit_ceil(capacity < 2 ? 2 : capacity) - 1) {
+    slots_ = std::make_unique<slot[]>(mask_ + 1);
+  }
+
+  spsc_ring(const spsc_ring&) = delete;
+
+  ~spsc_ring() {
+    for (auto head = head_.load(); head != tail_.load(); ++head) {
+      std::launder(reinterpret_cast<T*>(slots_[head & mask_].data))->~T();
+    }
+  }
+
+  // Called by the producer only
+  template <typename U>
+  bool try_push(U&& value) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ > mask_) {
+      // Looks full, refresh the head written by the consumer
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ > mask_) {
+        return false;
+      }
+    }
+    ::new (slots_[tail & mask_].data) T(std::forward<U>(value));
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer only
+  bool try_pop(std::optional<T>& value) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      // Looks empty, refresh the tail written by the producer
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    auto ptr = std::launder(reinterpret_cast<T*>(slots_[head & mask_].data));
+    value.emplace(std::move(*ptr));
+    ptr->~T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ private:
+  struct slot {
+    alignas(T) std::byte data[sizeof(T)];
+  };
+
+  const size_t mask_;
+  std::unique_ptr<slot[]> slots_;
+  // Keep the indexes of producer and consumer on different cache lines
+  alignas(std::hardware_destructive_interference_size) std::atomic<size_t> head_ = 0;
+  size_t tail_cache_ = 0;  // The consumer's view of tail
+  alignas(std::hardware_destructive_interference_size) std::atomic<size_t> tail_ = 0;
+  size_t head_cache_ = 0;  // The producer's view of head
+};
+
+//
+// Prefetcher
+//
+
+template <typename Gen>
+class Prefetcher {
+ public:
+  using value_type = typename Gen::value_type;
+  using reference = const value_type&;
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Prefetcher::value_type;
+    using reference = Prefetcher::reference;
+    using pointer = const value_type*;
+
+    explicit iterator(Prefetcher& prefetcher) noexcept : prefetcher_(prefetcher) {}
+
+    friend bool operator==(const iterator& it, sentinel) noexcept { return it.prefetcher_.Done(); }
+
+    iterator& operator++() {
+      prefetcher_.Next();
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    reference operator*() const { return prefetcher_.Get(); }
+
+   private:
+    Prefetcher& prefetcher_;
+  };
+
+  //
+  // Prefetcher
+  //
+
+  Prefetcher(Gen&& gen, size_t depth) : gen_(std::move(gen)), ring_(depth) {
+    worker_ = std::jthread([this](std::stop_token stop) { Produce(stop); });
+  }
+
+  Prefetcher(const Prefetcher&) = delete;
+
+  ~Prefetcher() {
+    // Stop the producer, the frame is destroyed with gen_ after the worker is joined
+    worker_.request_stop();
+    worker_.join();
+  }
+
+  bool Next() {
+    while (!ring_.try_pop(value_)) {
+      if (finished_.load(std::memory_order_acquire)) {
+        // The values pushed before finished may haven't been popped
+        if (ring_.try_pop(value_)) {
+          return true;
+        }
+        done_ = true;
+        if (exception_) {
+          std::rethrow_exception(std::exchange(exception_, {}));
+        }
+        return false;
+      }
+      std::this_thread::yield();
+    }
+    return true;
+  }
+
+  reference Get() const { return *value_; }
+
+  bool Done() const { return done_; }
+
+  iterator begin() {
+    Next();  // Initial read
+    return iterator(*this);
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  // Run on the worker thread
+  void Produce(std::stop_token stop) {
+    try {
+      while (!stop.stop_requested() && gen_.Next()) {
+        while (!ring_.try_push(gen_.Get())) {
+          if (stop.stop_requested()) {
+            return;
+          }
+          std::this_thread::yield();
+        }
+      }
+    } catch (...) {
+      // Published by the release store below
+      exception_ = std::current_exception();
+    }
+    finished_.store(true, std::memory_order_release);
+  }
+
+  Gen gen_;
+  spsc_ring<value_type> ring_;
+  std::atomic<bool> finished_ = false;
+  std::exception_ptr exception_;
+  // Consumer side
+  std::optional<value_type> value_;
+  bool done_ = false;
+  // Start the worker at last
+  std::jthread worker_;
+};
+
+template <typename Gen>
+Prefetcher<Gen> prefetch(Gen gen, size_t depth) {
+  return Prefetcher<Gen>(std::move(gen), depth);
+}
+
+//
+// The real logic
+//
+
+// Simulate the cost of decoding / processing
+uint64_t busy_work(uint64_t x, int rounds) {
+  for (int i = 0; i < rounds; ++i) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return x;
+}
+
+Generator<uint64_t> decode(size_t num, int rounds) {
+  for (size_t i = 0; i < num; ++i) {
+    co_yield busy_work(i, rounds);
+  }
+}
+
+Generator<int> counter(int num) {
+  for (int i = 0;; ++i) {
+    if (i == num) {
+      throw std::runtime_error("bad input");
+    }
+    co_yield i;
+  }
+}
+
+Generator<int> forever() {
+  for (int i = 0;; ++i) {
+    co_yield i;
+  }
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage 1: The exception is rethrown after the values produced before it
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  try {
+    for (auto value : prefetch(counter(3), 2)) {
+      std::cout << "main:" << value << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cout << "main: caught " << e.what() << std::endl;
+  }
+  //
+  // Usage 2: Stop early, the worker is stopped and joined
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  for (auto value : prefetch(forever(), 16)) {
+    if (value == 3) {
+      break;
+    }
+    std::cout << "main:" << value << std::endl;
+  }
+  //
+  // Benchmark: the producer and the consumer cost the same
+  //
+  constexpr size_t num = 200000;
+  constexpr int rounds = 500;
+  uint64_t sum1 = 0, sum2 = 0;
+  auto serial_ms = measure([&sum1] {
+    for (auto value : decode(num, rounds)) {
+      sum1 += busy_work(value, rounds);
+    }
+  });
+  auto prefetch_ms = measure([&sum2] {
+    for (auto value : prefetch(decode(num, rounds), 256)) {
+      sum2 += busy_work(value, rounds);
+    }
+  });
+  std::cout << "[+] Benchmark: " << num << " values, hardware threads:" << std::thread::hardware_concurrency()
+            << std::endl;
+  std::cout << "serial:" << serial_ms << "ms (" << num / serial_ms * 1e3 << " values/s)" << std::endl;
+  std::cout << "prefetch:" << prefetch_ms << "ms (" << num / prefetch_ms * 1e3 << " values/s)" << std::endl;
+  std::cout << "sum:" << (sum1 == sum2 ? "match" : "mismatch") << std::endl;
+  return sum1 == sum2 ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage1
+main:0
+main:1
+main:2
+main: caught bad input
+[+] Usage2
+main:0
+main:1
+main:2
+[+] Benchmark: 200000 values, hardware threads:1
+serial:312.2ms (640682 values/s)
+prefetch:307.8ms (649821 values/s)
+sum:match
+
+NOTE: The numbers above are from a single core machine, so there's nothing to overlap. With 2 or more cores the
+prefetch version is expected to take about max(producer, consumer) instead of producer + consumer, i.e. close to 2x
+throughput when both sides cost the same.
+*/
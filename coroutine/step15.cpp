@@ -0,0 +1,362 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 14:26:40
+ *
+ * File Name: step15.cpp
+ * Description:
+ *
+ *  Step 15: Order-preserving parallel map over a generator
+ *  - `parallel_map(gen, f, workers, window)` pulls values from the generator, evaluates `f` on a pool of workers and
+ *    yields the results in input order.
+ *  - At most `window` values are in flight, so the memory stays bounded however long the source is.
+ *  - `workers` and `window` must be at least 1, otherwise std::invalid_argument is thrown.
+ *
+ */
+
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// The generator of step 12
+//
+
+template <typename T>
+class Generator {
+ public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = const value_type&;
+  using pointer = const value_type*;
+
+  //
+  // Promise
+  //
+  class promise_type {
+   public:
+    Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    std::suspend_always yield_value(reference value) noexcept {
+      value_ = std::addressof(value);
+      return {};
+    }
+
+    template <typename From>
+      requires(std::convertible_to<From, value_type> && !std::same_as<std::remove_cvref_t<From>, value_type>)
+    auto yield_value(From&& from) {
+      struct convert_awaiter {
+        value_type value_;
+        promise_type& promise_;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) noexcept { promise_.value_ = std::addressof(value_); }
+        constexpr void await_resume() const noexcept {}
+      };
+
+      return convert_awaiter{value_type(std::forward<From>(from)), *this};
+    }
+
+    pointer value_ = nullptr;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+    using reference = Generator::reference;
+    using pointer = Generator::pointer;
+
+    explicit iterator(Generator& gen) noexcept : gen_(gen) {}
+
+    friend bool operator==(const iterator& it, sentinel) noexcept { return it.gen_.Done(); }
+
+    iterator& operator++() {
+      gen_.Next();
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    reference operator*() const { return gen_.Get(); }
+
+   private:
+    Generator& gen_;
+  };
+
+  //
+  // Generator
+  //
+
+  explicit Generator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Generator(const Generator&) = delete;
+
+  ~Generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool Next() {
+    if (handle_.done()) {
+      return false;
+    }
+    handle_();
+    if (auto exception = std::exchange(handle_.promise().exception_, {}); exception) {
+      std::rethrow_exception(exception);
+    }
+    return !handle_.done();
+  }
+
+  reference Get() const { return *handle_.promise().value_; }
+
+  bool Done() const { return handle_.done(); }
+
+  iterator begin() {
+    Next();  // Initial read
+    return iterator(*this);
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// A simple thread pool
+//
+
+class ThreadPool {
+ public:
+  explicit ThreadPool(size_t workers) {
+    for (size_t i = 0; i < workers; ++i) {
+      threads_.emplace_back([this] { Run(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(m_);
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  template <typename F>
+  auto Submit(F&& f) {
+    using R = std::invoke_result_t<F&>;
+    // std::function requires a copyable callable, so the task is shared
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+    auto future = task->get_future();
+    {
+      std::lock_guard lock(m_);
+      tasks_.emplace([task] { (*task)(); });
+    }
+    cv_.notify_one();
+    return future;
+  }
+
+ private:
+  void Run() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock lock(m_);
+        cv_.wait(lock, [this] { return stopped_ || !tasks_.empty(); });
+        if (stopped_) {
+          // The tasks not started are dropped, nobody is waiting for them any more
+          return;
+        }
+        task = std::move(tasks_.front());
+        tasks_.pop();
+      }
+      task();
+    }
+  }
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::queue<std::function<void()>> tasks_;
+  bool stopped_ = false;
+  std::vector<std::thread> threads_;
+};
+
+//
+// Parallel map
+//
+//  The results are yielded from the front of the window, so the order is the same as the input. When the consumer
+//  stops early, the frame is destroyed: the pending futures are dropped first and then the pool joins its workers,
+//  while `f` (a parameter, destroyed after the locals) is still alive.
+//
+
+template <typename Gen, typename F,
+          typename R = std::remove_cvref_t<std::invoke_result_t<F&, const typename Gen::value_type&>>>
+Generator<R> parallel_map_window(Gen gen, F f, size_t workers, size_t window) {
+  ThreadPool pool(workers);
+  std::deque<std::future<R>> pending;
+  for (const auto& value : gen) {
+    pending.emplace_back(pool.Submit([&f, value] { return f(value); }));
+    if (pending.size() >= window) {
+      co_yield pending.front().get();  // Rethrow the exception of f
+      pending.pop_front();
+    }
+  }
+  while (!pending.empty()) {
+    co_yield pending.front().get();
+    pending.pop_front();
+  }
+}
+
+// The arguments are checked here rather than in the coroutine body, which only runs when the first value is pulled.
+// No worker or an empty window would wait forever for a future that never runs.
+template <typename Gen, typename F>
+auto parallel_map(Gen gen, F f, size_t workers, size_t window) {
+  if (workers == 0 || window == 0) {
+    throw std::invalid_argument("parallel_map: workers and window must be at least 1");
+  }
+  return parallel_map_window(std::move(gen), std::move(f), workers, window);
+}
+
+//
+// The real logic
+//
+
+// A CPU bound function
+uint64_t busy_work(uint64_t x, int rounds) {
+  for (int i = 0; i < rounds; ++i) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return x;
+}
+
+Generator<uint64_t> counter(uint64_t num) {
+  for (uint64_t i = 0; i < num; ++i) {
+    co_yield i;
+  }
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage 1: In order, even the earlier values take longer
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  auto slow_square = [](uint64_t x) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10 * (5 - x)));
+    return x * x;
+  };
+  for (auto value : parallel_map(counter(5), slow_square, 4, 8)) {
+    std::cout << "main:" << value << std::endl;
+  }
+  //
+  // Usage 2: Exception of f
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  auto fail_at_2 = [](uint64_t x) {
+    if (x == 2) {
+      throw std::runtime_error("bad value");
+    }
+    return x;
+  };
+  try {
+    for (auto value : parallel_map(counter(5), fail_at_2, 2, 4)) {
+      std::cout << "main:" << value << std::endl;
+    }
+  } catch (const std::exception& e) {
+    std::cout << "main: caught " << e.what() << std::endl;
+  }
+  //
+  // Benchmark: scaling with the number of workers
+  //
+  constexpr uint64_t num = 20000;
+  constexpr int rounds = 20000;
+  auto f = [](uint64_t x) { return busy_work(x, rounds); };
+  uint64_t expected = 0;
+  auto serial_ms = measure([&] {
+    for (auto value : counter(num)) {
+      expected += f(value);
+    }
+  });
+  std::cout << "[+] Benchmark: " << num << " values, hardware threads:" << std::thread::hardware_concurrency()
+            << std::endl;
+  std::cout << "serial:" << serial_ms << "ms" << std::endl;
+  bool ok = true;
+  for (size_t workers : {1, 2, 4, 8, 16}) {
+    uint64_t sum = 0;
+    auto ms = measure([&] {
+      for (auto value : parallel_map(counter(num), f, workers, workers * 4)) {
+        sum += value;
+      }
+    });
+    ok = ok && sum == expected;
+    std::cout << "workers:" << workers << " " << ms << "ms speedup:" << serial_ms / ms << std::endl;
+  }
+  std::cout << "sum:" << (ok ? "match" : "mismatch") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage1
+main:0
+main:1
+main:4
+main:9
+main:16
+[+] Usage2
+main:0
+main:1
+main: caught bad value
+[+] Benchmark: 20000 values, hardware threads:1
+serial:618.5ms
+workers:1 695.5ms speedup:0.89
+workers:2 698.6ms speedup:0.89
+workers:4 642.7ms speedup:0.96
+workers:8 668.6ms speedup:0.93
+workers:16 659.8ms speedup:0.94
+sum:match
+
+NOTE: The numbers above are from a single core machine, which only shows the overhead of the pool (~10%, a mutex
+and a future per value). Each value costs ~30us here, so on N cores the speedup is expected to be close to N until
+the consumer thread (which also pulls the source) becomes the bottleneck. Make `f` coarser or batch the values when
+it costs only a few microseconds.
+*/
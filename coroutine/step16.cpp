@@ -0,0 +1,462 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 14:05:52
+ *
+ * File Name: step16.cpp
+ * Description:
+ *
+ *  Step 16: Read a file as a generator of std::string_view, without copy
+ *  - Reading lines by std::getline copies each of them into a std::string. Here the file is mapped by mmap (with the
+ *    MADV_SEQUENTIAL hint), the delimiters are found by a SSE2 scan of 64 bytes per step, and the generator of step 12
+ *    yields std::string_view pointing into the mapping.
+ *  - `read_lines(path)` splits by a delimiter, `read_records(path, size)` splits into fixed size records (the last
+ *    one may be shorter). A record_size of 0 throws std::invalid_argument.
+ *  - A file larger than the window (1GB by default) is mapped window by window. A line crossing the end of a window
+ *    starts the next one, and a line longer than the window doubles it.
+ *  - A view is valid until the generator resumes, the window it points into may be unmapped then.
+ *
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+//
+// The generator of step 12
+//
+
+template <typename T>
+class Generator {
+ public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = const value_type&;
+  using pointer = const value_type*;
+
+  //
+  // Promise
+  //
+  class promise_type {
+   public:
+    Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    // Both lvalues and temporaries bind here. A temporary is not destroyed until the coroutine resumes from this
+    // co_yield, so it's safe to keep the address.
+    std::suspend_always yield_value(reference value) noexcept {
+      value_ = std::addressof(value);
+      return {};
+    }
+
+    // Values of other types are converted into the awaiter, which also lives in the frame during the suspension.
+    template <typename From>
+      requires(std::convertible_to<From, value_type> && !std::same_as<std::remove_cvref_t<From>, value_type>)
+    auto yield_value(From&& from) {
+      struct convert_awaiter {
+        value_type value_;
+        promise_type& promise_;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) noexcept { promise_.value_ = std::addressof(value_); }
+        constexpr void await_resume() const noexcept {}
+      };
+
+      return convert_awaiter{value_type(std::forward<From>(from)), *this};
+    }
+
+    pointer value_ = nullptr;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+    using reference = Generator::reference;
+    using pointer = Generator::pointer;
+
+    explicit iterator(Generator& gen) noexcept : gen_(gen) {}
+
+    friend bool operator==(const iterator& it, sentinel) noexcept { return it.gen_.Done(); }
+
+    iterator& operator++() {
+      gen_.Next();
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    // Read the value in place, there's no copy at all
+    reference operator*() const { return *gen_.handle_.promise().value_; }
+
+    pointer operator->() const { return gen_.handle_.promise().value_; }
+
+   private:
+    Generator& gen_;
+  };
+
+  //
+  // Generator
+  //
+
+  explicit Generator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Generator(const Generator&) = delete;
+
+  ~Generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool Next() {
+    if (handle_.done()) {
+      return false;
+    }
+    handle_();
+    if (auto exception = std::exchange(handle_.promise().exception_, {}); exception) {
+      std::rethrow_exception(exception);
+    }
+    return !handle_.done();
+  }
+
+  // Only valid after Next() returns true, and until the next call of Next()
+  reference Get() const { return *handle_.promise().value_; }
+
+  bool Done() const { return handle_.done(); }
+
+  iterator begin() {
+    Next();  // Initial read
+    return iterator(*this);
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// Mapped file
+//
+
+class mapped_file {
+ public:
+  explicit mapped_file(const std::string& path) : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+    if (fd_ < 0) {
+      throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      int error = errno;
+      ::close(fd_);
+      throw std::system_error(error, std::generic_category(), "fstat " + path);
+    }
+    size_ = static_cast<size_t>(st.st_size);
+  }
+
+  mapped_file(const mapped_file&) = delete;
+
+  ~mapped_file() {
+    unmap();
+    ::close(fd_);
+  }
+
+  size_t size() const { return size_; }
+
+  // Map [offset, offset + length) of the file (cut at the end of file), and unmap the previous window
+  std::string_view map(size_t offset, size_t length) {
+    unmap();
+    static const size_t page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    size_t base = offset / page_size * page_size;
+    size_t end = std::min(size_, offset + length);
+    length_ = end - base;
+    void* addr = ::mmap(nullptr, length_, PROT_READ, MAP_PRIVATE, fd_, static_cast<off_t>(base));
+    if (addr == MAP_FAILED) {
+      length_ = 0;
+      throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    addr_ = addr;
+    // Read ahead aggressively, and drop the pages behind
+    ::madvise(addr_, length_, MADV_SEQUENTIAL);
+    return {static_cast<const char*>(addr_) + (offset - base), end - offset};
+  }
+
+ private:
+  void unmap() {
+    if (addr_) {
+      ::munmap(addr_, length_);
+      addr_ = nullptr;
+    }
+  }
+
+  int fd_;
+  size_t size_ = 0;
+  void* addr_ = nullptr;
+  size_t length_ = 0;
+};
+
+//
+// Delimiter scan, as memchr
+//
+
+// The index of the first `byte` in [data, data + size), or size
+inline size_t find_byte(const char* data, size_t size, char byte) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i needle = _mm_set1_epi8(byte);
+  auto match = [&](size_t offset) {
+    return _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)), needle);
+  };
+  // 64 bytes per step, one branch
+  for (; i + 64 <= size; i += 64) {
+    __m128i m0 = match(i), m1 = match(i + 16), m2 = match(i + 32), m3 = match(i + 48);
+    if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(m0, m1), _mm_or_si128(m2, m3)))) {
+      uint64_t mask = uint64_t(_mm_movemask_epi8(m0)) | uint64_t(_mm_movemask_epi8(m1)) << 16 |
+                      uint64_t(_mm_movemask_epi8(m2)) << 32 | uint64_t(_mm_movemask_epi8(m3)) << 48;
+      return i + __builtin_ctzll(mask);
+    }
+  }
+  for (; i + 16 <= size; i += 16) {
+    if (int mask = _mm_movemask_epi8(match(i)); mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i < size; ++i) {
+    if (data[i] == byte) {
+      return i;
+    }
+  }
+  return size;
+}
+
+//
+// The real logic
+//
+
+constexpr size_t default_window = size_t(1) << 30;
+
+// The lines without the delimiter. The last line may have no delimiter.
+Generator<std::string_view> read_lines(std::string path, char delimiter = '\n', size_t window = default_window) {
+  mapped_file file(path);
+  size_t begin = 0;  // The offset of the current line in the file
+  while (begin < file.size()) {
+    auto view = file.map(begin, window);
+    bool last_window = begin + view.size() == file.size();
+    size_t pos = 0;
+    while (pos < view.size()) {
+      size_t length = find_byte(view.data() + pos, view.size() - pos, delimiter);
+      if (pos + length == view.size() && !last_window) {
+        break;  // The line continues in the next window
+      }
+      co_yield view.substr(pos, length);
+      pos += length + 1;
+    }
+    if (pos == 0) {
+      window *= 2;  // The line is longer than the window
+    }
+    begin += std::min(pos, view.size());
+  }
+}
+
+// Fixed size records, the last one may be shorter
+Generator<std::string_view> read_records_window(std::string path, size_t record_size, size_t window) {
+  mapped_file file(path);
+  // Whole records per window
+  window = std::max(window / record_size, size_t(1)) * record_size;
+  for (size_t begin = 0; begin < file.size(); begin += window) {
+    auto view = file.map(begin, window);
+    for (size_t pos = 0; pos < view.size(); pos += record_size) {
+      co_yield view.substr(pos, record_size);
+    }
+  }
+}
+
+// Checked before the coroutine starts, an empty record would divide by zero
+Generator<std::string_view> read_records(std::string path, size_t record_size, size_t window = default_window) {
+  if (record_size == 0) {
+    throw std::invalid_argument("read_records: record_size must be at least 1");
+  }
+  return read_records_window(std::move(path), record_size, window);
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct summary {
+  size_t lines = 0;
+  size_t bytes = 0;
+  size_t checksum = 0;
+
+  void add(std::string_view line) {
+    ++lines;
+    bytes += line.size();
+    checksum = checksum * 31 + (line.empty() ? 0 : static_cast<unsigned char>(line.back()));
+  }
+
+  bool operator==(const summary&) const = default;
+};
+
+summary getline_summary(const std::string& path) {
+  summary result;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    result.add(line);
+  }
+  return result;
+}
+
+summary mmap_summary(const std::string& path, size_t window = default_window) {
+  summary result;
+  for (auto line : read_lines(path, '\n', window)) {
+    result.add(line);
+  }
+  return result;
+}
+
+// Lines of 0 to 300 bytes, like a log file
+void write_file(const std::string& path, size_t size, uint32_t seed) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  std::mt19937 rng(seed);
+  std::string line;
+  for (size_t written = 0; written < size;) {
+    line.assign(rng() % 300, ' ');
+    for (auto& c : line) {
+      c = static_cast<char>('a' + rng() % 26);
+    }
+    line += '\n';
+    out << line;
+    written += line.size();
+  }
+  out << "the last line has no delimiter";
+}
+
+int main() {
+  const std::string path = "/tmp/step16.txt";
+  //
+  // Usage 1: Lines
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  {
+    std::ofstream(path, std::ios::trunc) << "first\n\nthird\nno delimiter";
+  }
+  for (auto line : read_lines(path)) {
+    std::cout << "main:[" << line << "]" << std::endl;
+  }
+  //
+  // Usage 2: Records
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  {
+    std::ofstream(path, std::ios::trunc) << "rec0001rec0002rec0003rec";
+  }
+  for (auto record : read_records(path, 7)) {
+    std::cout << "main:[" << record << "]" << std::endl;
+  }
+  //
+  // Usage 3: Small windows, the lines cross the windows, and a line is longer than the window
+  //
+  std::cout << "[+] Usage3" << std::endl;
+  write_file(path, 1 << 20, 1);
+  {
+    std::ofstream(path, std::ios::app) << '\n' << std::string(20000, 'x') << "\nend";
+  }
+  auto expected = getline_summary(path);
+  bool ok = true;
+  for (size_t window : {size_t(4096), size_t(65536), default_window}) {
+    bool match = mmap_summary(path, window) == expected;
+    ok = ok && match;
+    std::cout << "window " << window << ": " << (match ? "match" : "MISMATCH") << std::endl;
+  }
+  //
+  // Benchmark: a warm file in page cache
+  //
+  constexpr size_t size = size_t(512) << 20;
+  write_file(path, size, 2);
+  getline_summary(path);  // Warm up
+  summary s1, s2, s3;
+  auto getline_ms = measure([&] { s1 = getline_summary(path); });
+  auto mmap_ms = measure([&] { s2 = mmap_summary(path); });
+  auto window_ms = measure([&] { s3 = mmap_summary(path, size_t(64) << 20); });
+  summary s4;
+  auto records_ms = measure([&] {
+    for (auto record : read_records(path, 128)) {
+      s4.add(record);
+    }
+  });
+  size_t file_size = mapped_file(path).size();
+  ok = ok && s1 == s2 && s2 == s3 && s4.bytes == file_size;
+  auto gbps = [&](double ms) { return double(file_size) / ms / 1e6; };
+  std::cout << "[+] Benchmark: " << s1.lines << " lines, " << (size >> 20) << "MB (GB/s)" << std::endl;
+  std::cout << "std::getline: " << gbps(getline_ms) << std::endl;
+  std::cout << "read_lines: " << gbps(mmap_ms) << std::endl;
+  std::cout << "read_lines (64MB windows): " << gbps(window_ms) << std::endl;
+  std::cout << "read_records (128 bytes): " << gbps(records_ms) << std::endl;
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  std::remove(path.c_str());
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine, the file is in the page cache):
+[+] Usage1
+main:[first]
+main:[]
+main:[third]
+main:[no delimiter]
+[+] Usage2
+main:[rec0001]
+main:[rec0002]
+main:[rec0003]
+main:[rec]
+[+] Usage3
+window 4096: match
+window 65536: match
+window 1073741824: match
+[+] Benchmark: 3565689 lines, 512MB (GB/s)
+std::getline: 1.45
+read_lines: 2.81
+read_lines (64MB windows): 2.72
+read_records (128 bytes): 21.42
+OK
+*/
@@ -0,0 +1,674 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 15:31:44
+ *
+ * File Name: step17.cpp
+ * Description:
+ *
+ *  Step 17: Account the coroutine frames
+ *  - How large is the frame of simple_func, mock_heavy_func or a Generator, how many of them are alive, and how long
+ *    they live? These decide the memory of a service with 100k concurrent tasks.
+ *  - The promise types of step 10 and step 12 derive from `accounted_frame`, whose operator new / delete count the
+ *    frames per coroutine function: the frame size, the allocations, the bytes, the live and peak live frames, and a
+ *    histogram of the lifetimes. `frame_accounting::report()` prints them.
+ *  - The coroutine function is told by a `std::source_location` default argument of operator new. It's evaluated
+ *    where the compiler calls operator new, that's in the coroutine function itself, so it names the coroutine even
+ *    when it's inlined into the caller.
+ *  - The accounting is opt-in: compile with -DCOROUTINE_FRAME_ACCOUNTING=1 to enable it. By default
+ *    `accounted_frame` is empty and the frames go to the global operator new, so there's no cost at all.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <queue>
+#include <semaphore>
+#include <source_location>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+#ifndef COROUTINE_FRAME_ACCOUNTING
+#define COROUTINE_FRAME_ACCOUNTING 0
+#endif
+
+//
+// Frame accounting
+//
+
+namespace frame_accounting {
+
+// Bucket k counts the lifetimes in [2^(k-1), 2^k) microseconds, bucket 0 the ones below 1us
+constexpr size_t num_lifetime_buckets = 32;
+
+struct site_stats {
+  std::string function;
+  size_t frame_size;
+  uint64_t allocations;
+  uint64_t bytes;
+  uint64_t live;
+  uint64_t peak_live;
+  std::array<uint64_t, num_lifetime_buckets> lifetimes;
+};
+
+struct totals {
+  uint64_t live_bytes;
+  uint64_t peak_live_bytes;
+};
+
+#if COROUTINE_FRAME_ACCOUNTING
+
+namespace detail {
+
+// The counters of one coroutine function. Frames may be created and destroyed on any thread.
+struct site {
+  std::atomic<const char*> function{nullptr};
+  std::atomic<size_t> frame_size{0};
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> live{0};
+  std::atomic<uint64_t> peak_live{0};
+  std::array<std::atomic<uint64_t>, num_lifetime_buckets> lifetimes{};
+};
+
+constexpr size_t max_sites = 256;
+inline site sites[max_sites];
+inline std::atomic<uint64_t> live_bytes{0};
+inline std::atomic<uint64_t> peak_live_bytes{0};
+
+inline void update_peak(std::atomic<uint64_t>& peak, uint64_t value) {
+  auto current = peak.load(std::memory_order_relaxed);
+  while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+// Open addressing by the function name, lock free. Nullptr when the table is full, then the frame is not accounted.
+inline site* site_of(const char* function) {
+  size_t index = (reinterpret_cast<uintptr_t>(function) * 0x9e3779b97f4a7c15ull) >> 56;
+  for (size_t probe = 0; probe < max_sites; ++probe, index = (index + 1) % max_sites) {
+    const char* current = sites[index].function.load(std::memory_order_acquire);
+    if (current == nullptr &&
+        sites[index].function.compare_exchange_strong(current, function, std::memory_order_acq_rel)) {
+      return &sites[index];
+    }
+    if (current == function) {
+      return &sites[index];
+    }
+  }
+  return nullptr;
+}
+
+// Stored in front of the frame, keeps the alignment of the frame
+struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) header {
+  site* owner;
+  std::chrono::steady_clock::time_point created;
+};
+
+inline size_t lifetime_bucket(std::chrono::steady_clock::duration lifetime) {
+  auto us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(lifetime).count());
+  return std::min<size_t>(std::bit_width(us), num_lifetime_buckets - 1);
+}
+
+}  // namespace detail
+
+// The base of the promise types
+struct accounted_frame {
+  // The default argument is evaluated in the coroutine function
+  static void* operator new(std::size_t size, std::source_location location = std::source_location::current()) {
+    using namespace detail;
+    auto owner = site_of(location.function_name());
+    auto h = static_cast<header*>(::operator new(sizeof(header) + size));
+    ::new (h) header{owner, std::chrono::steady_clock::now()};
+    if (owner) {
+      owner->frame_size.store(size, std::memory_order_relaxed);
+      owner->allocations.fetch_add(1, std::memory_order_relaxed);
+      owner->bytes.fetch_add(size, std::memory_order_relaxed);
+      update_peak(owner->peak_live, owner->live.fetch_add(1, std::memory_order_relaxed) + 1);
+    }
+    update_peak(peak_live_bytes, live_bytes.fetch_add(size, std::memory_order_relaxed) + size);
+    return h + 1;
+  }
+
+  static void operator delete(void* ptr, std::size_t size) noexcept {
+    using namespace detail;
+    auto h = static_cast<header*>(ptr) - 1;
+    if (h->owner) {
+      h->owner->live.fetch_sub(1, std::memory_order_relaxed);
+      auto bucket = lifetime_bucket(std::chrono::steady_clock::now() - h->created);
+      h->owner->lifetimes[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+    live_bytes.fetch_sub(size, std::memory_order_relaxed);
+    ::operator delete(h, sizeof(header) + size);
+  }
+};
+
+inline std::vector<site_stats> snapshot() {
+  std::vector<site_stats> result;
+  for (auto& s : detail::sites) {
+    auto function = s.function.load(std::memory_order_acquire);
+    if (!function) {
+      continue;
+    }
+    site_stats stats{function,
+                     s.frame_size.load(std::memory_order_relaxed),
+                     s.allocations.load(std::memory_order_relaxed),
+                     s.bytes.load(std::memory_order_relaxed),
+                     s.live.load(std::memory_order_relaxed),
+                     s.peak_live.load(std::memory_order_relaxed),
+                     {}};
+    for (size_t i = 0; i < num_lifetime_buckets; ++i) {
+      stats.lifetimes[i] = s.lifetimes[i].load(std::memory_order_relaxed);
+    }
+    result.push_back(std::move(stats));
+  }
+  // The most churn first
+  std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) { return a.bytes > b.bytes; });
+  return result;
+}
+
+inline totals total() {
+  return {detail::live_bytes.load(std::memory_order_relaxed), detail::peak_live_bytes.load(std::memory_order_relaxed)};
+}
+
+inline void report(std::ostream& out) {
+  auto t = total();
+  out << "[frame accounting] live bytes:" << t.live_bytes << " peak live bytes:" << t.peak_live_bytes << std::endl;
+  for (const auto& s : snapshot()) {
+    out << "  " << s.function << std::endl;
+    out << "    frame:" << s.frame_size << "B allocations:" << s.allocations << " bytes:" << s.bytes
+        << " live:" << s.live << " peak live:" << s.peak_live << std::endl;
+    out << "    lifetimes:";
+    for (size_t i = 0; i < num_lifetime_buckets; ++i) {
+      if (s.lifetimes[i]) {
+        out << " <" << (uint64_t(1) << i) << "us:" << s.lifetimes[i];
+      }
+    }
+    out << std::endl;
+  }
+}
+
+#else
+
+// Nothing at all, the frames go to the global operator new
+struct accounted_frame {};
+
+inline std::vector<site_stats> snapshot() { return {}; }
+
+inline totals total() { return {}; }
+
+inline void report(std::ostream& out) { out << "[frame accounting] disabled" << std::endl; }
+
+#endif
+
+}  // namespace frame_accounting
+
+using frame_accounting::accounted_frame;
+
+//
+// The awaitable and the scheduler of step 10
+//
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type : public accounted_frame {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept {
+      if (spawn_ && caller_handle_) {
+        // The callee is completed, and we should schedule the await_resume of caller. (by calling caller_handle())
+        spawn_(caller_handle_);
+      }
+      return {};
+    }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    handle_.destroy();
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<promise_type> h) {
+    // Progragate spawn function from caller to callee and set caller. We can then call spawn_(caller_handle) to resume
+    // the caller later.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    promise.set_spawn(h.promise().get_spawn());
+  }
+
+  T& await_resume() noexcept { return value(); }
+
+  bool done() noexcept { return handle_.done(); }
+
+  T& value() noexcept {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <typename T>
+class await_callback {
+ public:
+  await_callback() {}
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<typename awaitable<T>::promise_type> h) {
+    handle_ = h;
+    return false;
+  }
+
+  auto await_resume() noexcept {
+    return [h = this->handle_] {
+      // Add the handle to scheduler to continue the coroutine.
+      h.promise().get_spawn()(h);
+    };
+  }
+
+ private:
+  std::coroutine_handle<typename awaitable<T>::promise_type> handle_;
+};
+
+awaitable<int> mock_heavy_func(int x) {
+  auto callback = co_await await_callback<int>();  // Will not suspend
+  std::thread thread([x, callback] {
+    std::this_thread::sleep_for(x * 1ms);
+    callback();  // Tell current coroutine to continue
+  });
+  thread.detach();
+  co_await std::suspend_always{};
+  co_return x;
+}
+
+awaitable<int> simple_func(int x) {
+  auto value = co_await mock_heavy_func(x);
+  co_return value + 1;
+}
+
+awaitable<int> complex_func() {
+  auto await1 = simple_func(1);
+  auto await2 = simple_func(2);
+  auto await3 = simple_func(3);
+  auto await4 = simple_func(4);
+  auto value = co_await await1 + co_await await2 + co_await await3 + co_await await4;
+  co_return value;
+}
+
+//
+// A simple scheduler
+//
+
+template <typename T>
+T spawn(awaitable<T>&& task) {
+  //
+  // Handle queue and spawn function
+  //
+  std::mutex m;
+  std::counting_semaphore queue_size{0};
+  std::queue<std::coroutine_handle<>> h_queue;
+  spawn_function spawn = [&m, &queue_size, &h_queue](std::coroutine_handle<> h) {
+    {
+      std::lock_guard lock(m);
+      h_queue.emplace(h);
+    }
+    queue_size.release();
+  };
+
+  // Set spawn function (And will actually run the function)
+  task.set_spawn(spawn);
+
+  //
+  // Run handles (Yes, we can implement it in a multi-thread way, it's quite easy to do that)
+  //
+  //  For an industrial implementation, we must consider the following things:
+  //
+  //    1. Cancellation
+  //    2. Effective way to enqueue / dequeue
+  //    3. Dead lock detection
+  //    4. ...
+  //
+  //  Remember: this is just a very simple prototype.
+  //
+  while (!task.done()) {
+    // When all coroutines of current scheduler are suspend. The scheduler should wait for any coroutine becoming ready
+    // to continue (e.g. data received from a socket, user input a string, ...).
+    queue_size.acquire();
+    // Run handles
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard lock(m);
+      handle = h_queue.front();
+      h_queue.pop();
+    }
+    handle();
+  }
+
+  return task.value();
+}
+
+//
+// The generator of step 12
+//
+
+template <typename T>
+class Generator {
+ public:
+  using value_type = std::remove_cvref_t<T>;
+  using reference = const value_type&;
+  using pointer = const value_type*;
+
+  //
+  // Promise
+  //
+  class promise_type : public accounted_frame {
+   public:
+    Generator get_return_object() { return Generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception_ = std::current_exception(); }
+    void return_void() {}
+
+    // Both lvalues and temporaries bind here. A temporary is not destroyed until the coroutine resumes from this
+    // co_yield, so it's safe to keep the address.
+    std::suspend_always yield_value(reference value) noexcept {
+      value_ = std::addressof(value);
+      return {};
+    }
+
+    // Values of other types are converted into the awaiter, which also lives in the frame during the suspension.
+    template <typename From>
+      requires(std::convertible_to<From, value_type> && !std::same_as<std::remove_cvref_t<From>, value_type>)
+    auto yield_value(From&& from) {
+      struct convert_awaiter {
+        value_type value_;
+        promise_type& promise_;
+
+        constexpr bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<>) noexcept { promise_.value_ = std::addressof(value_); }
+        constexpr void await_resume() const noexcept {}
+      };
+
+      return convert_awaiter{value_type(std::forward<From>(from)), *this};
+    }
+
+    pointer value_ = nullptr;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Iterator
+  //
+
+  class sentinel {};
+
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = Generator::value_type;
+    using reference = Generator::reference;
+    using pointer = Generator::pointer;
+
+    explicit iterator(Generator& gen) noexcept : gen_(gen) {}
+
+    friend bool operator==(const iterator& it, sentinel) noexcept { return it.gen_.Done(); }
+
+    iterator& operator++() {
+      gen_.Next();
+      return *this;
+    }
+
+    void operator++(int) { operator++(); }
+
+    // Read the value in place, there's no copy at all
+    reference operator*() const { return *gen_.handle_.promise().value_; }
+
+    pointer operator->() const { return gen_.handle_.promise().value_; }
+
+   private:
+    Generator& gen_;
+  };
+
+  //
+  // Generator
+  //
+
+  explicit Generator(const std::coroutine_handle<promise_type>& handle) : handle_(handle) {}
+
+  Generator(Generator&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  Generator(const Generator&) = delete;
+
+  ~Generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool Next() {
+    if (handle_.done()) {
+      return false;
+    }
+    handle_();
+    if (auto exception = std::exchange(handle_.promise().exception_, {}); exception) {
+      std::rethrow_exception(exception);
+    }
+    return !handle_.done();
+  }
+
+  // Only valid after Next() returns true, and until the next call of Next()
+  reference Get() const { return *handle_.promise().value_; }
+
+  bool Done() const { return handle_.done(); }
+
+  iterator begin() {
+    Next();  // Initial read
+    return iterator(*this);
+  }
+
+  sentinel end() noexcept { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle_;
+};
+
+Generator<int> range(int num) {
+  for (int i = 0; i < num; ++i) {
+    co_yield i;
+  }
+}
+
+Generator<int> session(int id) {
+  char buffer[256] = {};  // Local state lives in the frame
+  buffer[id % sizeof(buffer)] = 1;
+  for (int i = 0;; ++i) {
+    co_yield id + i + buffer[i % sizeof(buffer)];
+  }
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage 1: The tasks of step 10
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  std::cout << "result:" << spawn(complex_func()) << std::endl;
+  //
+  // Usage 2: 100k concurrent sessions
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  {
+    std::vector<Generator<int>> sessions;
+    sessions.reserve(100000);
+    for (int i = 0; i < 100000; ++i) {
+      sessions.push_back(session(i));
+      sessions.back().Next();
+    }
+    std::cout << "live bytes of 100000 sessions:" << frame_accounting::total().live_bytes << std::endl;
+  }
+  //
+  // Benchmark: short-lived generators, the cost of the accounting
+  //
+  constexpr int num = 1000000;
+  long sum = 0;
+  auto ms = measure([&sum] {
+    for (int i = 0; i < num; ++i) {
+      for (auto value : range(2)) {
+        sum += value;
+      }
+    }
+  });
+  std::cout << "[+] Benchmark: " << num << " short-lived generators" << std::endl;
+  std::cout << "accounting " << (COROUTINE_FRAME_ACCOUNTING ? "on" : "off") << ": " << ms * 1e6 / num
+            << "ns/generator (sum:" << sum << ")" << std::endl;
+  //
+  // Report
+  //
+  frame_accounting::report(std::cout);
+  return 0;
+}
+
+/*
+Outputs (-O2 -DCOROUTINE_FRAME_ACCOUNTING=1, the time varies by machine):
+[+] Usage1
+result:14
+[+] Usage2
+live bytes of 100000 sessions:32800000
+[+] Benchmark: 1000000 short-lived generators
+accounting on: 182.2ns/generator (sum:1000000)
+[frame accounting] live bytes:0 peak live bytes:32800000
+  Generator<int> range(int)
+    frame:64B allocations:1000000 bytes:64000000 live:0 peak live:1
+    lifetimes: <1us:999885 <2us:47 <4us:1 <8us:10 <16us:24 <32us:20 <64us:9 <128us:1 <256us:1 <512us:1 <2048us:1
+  Generator<int> session(int)
+    frame:328B allocations:100000 bytes:32800000 live:0 peak live:100000
+    lifetimes: <16384us:14436 <32768us:27772 <65536us:57792
+  awaitable<int> mock_heavy_func(int)
+    frame:136B allocations:4 bytes:544 live:0 peak live:1
+    lifetimes: <2048us:1 <4096us:2 <8192us:1
+  awaitable<int> simple_func(int)
+    frame:120B allocations:4 bytes:480 live:0 peak live:4
+    lifetimes: <16384us:4
+  awaitable<int> complex_func()
+    frame:136B allocations:1 bytes:136 live:0 peak live:1
+    lifetimes: <16384us:1
+
+Outputs (-O2):
+[+] Usage1
+result:14
+[+] Usage2
+live bytes of 100000 sessions:0
+[+] Benchmark: 1000000 short-lived generators
+accounting off: 39.9ns/generator (sum:1000000)
+[frame accounting] disabled
+*/
@@ -0,0 +1,612 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 16:48:10
+ *
+ * File Name: step18.cpp
+ * Description:
+ *
+ *  Step 18: A simulation scheduler with a virtual clock
+ *  - mock_heavy_func of step 10 sleeps for real, so a load test with realistic latencies runs as long as the load.
+ *  - `spawn(task, sim)` runs the awaitable of step 10 on a `simulation` instead: `co_await sleep_for(d)` puts the
+ *    coroutine into a timer heap of virtual time, and when no coroutine is ready, the clock jumps to the next deadline.
+ *    A run takes no wall time for the sleeps, and it's reproducible with the seed of `sim.rng()`.
+ *  - `sim.start(task)` runs a task without waiting for it, `sim.run()` runs until nothing is ready and no timer is
+ *    left. A task which is not done then is deadlocked, and spawn throws.
+ *  - `sim_semaphore` limits the concurrency with a FIFO or LIFO queue, the benchmark compares the two under overload.
+ *  - Changes to the awaitable of step 10: await_suspend accepts any caller promise, so awaitable<bool> could be awaited
+ *    by awaitable<int>, and a moved awaitable doesn't destroy the handle.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <optional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+//
+// The awaitable of step 10
+//
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept {
+      if (spawn_ && caller_handle_) {
+        // The callee is completed, and we should schedule the await_resume of caller. (by calling caller_handle())
+        spawn_(caller_handle_);
+      }
+      return {};
+    }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle, a moved awaitable has none (sim.start moves the tasks)
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    // Progragate spawn function from caller to callee and set caller. We can then call spawn_(caller_handle) to resume
+    // the caller later.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    promise.set_spawn(h.promise().get_spawn());
+  }
+
+  T& await_resume() noexcept { return value(); }
+
+  bool done() noexcept { return handle_.done(); }
+
+  T& value() noexcept {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// Simulation
+//
+
+class simulation {
+ public:
+  using duration = std::chrono::nanoseconds;
+
+  explicit simulation(uint64_t seed) : rng_(seed) {}
+
+  simulation(const simulation&) = delete;
+
+  // The virtual time since the start
+  duration now() const { return now_; }
+
+  std::mt19937_64& rng() { return rng_; }
+
+  uint64_t resumes() const { return resumes_; }
+
+  uint64_t clock_jumps() const { return clock_jumps_; }
+
+  // The simulation of the running coroutine, for the awaiters
+  static simulation& current() { return *current_; }
+
+  void schedule(std::coroutine_handle<> handle) { ready_.push_back(handle); }
+
+  // Called when a timer fires, returns whether to resume the coroutine
+  struct timer_hook {
+    virtual bool on_timer() = 0;
+  };
+
+  // Resume the coroutine at the deadline, returns the ticket to cancel it
+  uint64_t schedule_at(duration deadline, std::coroutine_handle<> handle, timer_hook* hook = nullptr) {
+    timers_.push({std::max(deadline, now_), next_sequence_, handle, hook});
+    return next_sequence_++;
+  }
+
+  void cancel(uint64_t ticket) { cancelled_.insert(ticket); }
+
+  spawn_function spawner() {
+    return [this](std::coroutine_handle<> handle) { schedule(handle); };
+  }
+
+  // Run the task without waiting for it
+  template <typename T>
+  void start(awaitable<T>&& task) {
+    auto owned = std::make_unique<detached<T>>(std::move(task));
+    owned->set_spawn(spawner());
+    detached_.push_back(std::move(owned));
+    // Drop the done ones from time to time
+    if (detached_.size() >= 2 * detached_after_sweep_) {
+      std::erase_if(detached_, [](const auto& t) { return t->done(); });
+      detached_after_sweep_ = std::max<size_t>(detached_.size(), 64);
+    }
+  }
+
+  // Run until the predicate is true or nothing could run. Returns the predicate.
+  template <typename Pred>
+  bool run_until(Pred&& pred) {
+    auto previous = std::exchange(current_, this);
+    while (!pred()) {
+      if (ready_.empty()) {
+        if (timers_.empty()) {
+          break;
+        }
+        // Everyone is blocked on timers: jump to the next deadline, and fire all the timers of that time
+        now_ = timers_.top().deadline;
+        ++clock_jumps_;
+        while (!timers_.empty() && timers_.top().deadline == now_) {
+          auto t = timers_.top();
+          timers_.pop();
+          if (!cancelled_.erase(t.sequence) && (!t.hook || t.hook->on_timer())) {
+            ready_.push_back(t.handle);
+          }
+        }
+        continue;
+      }
+      auto handle = ready_.front();
+      ready_.pop_front();
+      ++resumes_;
+      handle();
+    }
+    current_ = previous;
+    return pred();
+  }
+
+  void run() {
+    run_until([] { return false; });
+  }
+
+ private:
+  struct timer {
+    duration deadline;
+    uint64_t sequence;  // The same deadline resumes in the order of registration, for reproducibility
+    std::coroutine_handle<> handle;
+    timer_hook* hook;
+
+    bool operator>(const timer& other) const {
+      return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+    }
+  };
+
+  // A type erased owner of the detached tasks
+  struct detached_task {
+    virtual ~detached_task() = default;
+    virtual bool done() = 0;
+  };
+
+  template <typename T>
+  struct detached : detached_task, awaitable<T> {
+    explicit detached(awaitable<T>&& task) : awaitable<T>(std::move(task)) {}
+    bool done() override { return awaitable<T>::done(); }
+  };
+
+  static inline thread_local simulation* current_ = nullptr;
+
+  duration now_{0};
+  std::mt19937_64 rng_;
+  std::deque<std::coroutine_handle<>> ready_;
+  std::priority_queue<timer, std::vector<timer>, std::greater<>> timers_;
+  uint64_t next_sequence_ = 0;
+  std::unordered_set<uint64_t> cancelled_;
+  uint64_t resumes_ = 0;
+  uint64_t clock_jumps_ = 0;
+  std::vector<std::unique_ptr<detached_task>> detached_;
+  size_t detached_after_sweep_ = 64;
+};
+
+// Suspend for a duration of virtual time
+inline auto sleep_for(simulation::duration d) {
+  struct sleep_awaiter {
+    simulation::duration d_;
+
+    bool await_ready() const noexcept { return d_ <= simulation::duration::zero(); }
+
+    void await_suspend(std::coroutine_handle<> h) {
+      auto& sim = simulation::current();
+      sim.schedule_at(sim.now() + d_, h);
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  return sleep_awaiter{d};
+}
+
+// Run the task on the simulation, the same as spawn() of step 10
+template <typename T>
+T spawn(awaitable<T>&& task, simulation& sim) {
+  task.set_spawn(sim.spawner());
+  if (!sim.run_until([&task] { return task.done(); })) {
+    throw std::logic_error("simulation: deadlock, the task is not done and nothing could run");
+  }
+  return task.value();
+}
+
+// Counting semaphore of the simulation, the waiters are resumed in FIFO or LIFO order
+class sim_semaphore {
+ public:
+  enum class policy { fifo, lifo };
+
+  sim_semaphore(size_t count, policy p) : count_(count), policy_(p) {}
+
+  // Returns false when the deadline passes before a permit is acquired
+  auto acquire_until(simulation::duration deadline) {
+    struct acquire_awaiter : waiter, simulation::timer_hook {
+      sim_semaphore& sem_;
+      simulation::duration deadline_;
+      std::list<waiter*>::iterator pos_;
+
+      acquire_awaiter(sim_semaphore& sem, simulation::duration deadline) : sem_(sem), deadline_(deadline) {}
+
+      bool await_ready() noexcept {
+        if (sem_.count_ > 0) {
+          --sem_.count_;
+          granted_ = true;
+          return true;
+        }
+        return deadline_ <= simulation::current().now();
+      }
+
+      void await_suspend(std::coroutine_handle<> h) {
+        handle_ = h;
+        pos_ = sem_.waiters_.insert(sem_.waiters_.end(), this);
+        if (deadline_ != simulation::duration::max()) {
+          ticket_ = simulation::current().schedule_at(deadline_, h, this);
+        }
+      }
+
+      // Timed out, leave the queue
+      bool on_timer() override {
+        sem_.waiters_.erase(pos_);
+        return true;
+      }
+
+      bool await_resume() const noexcept { return granted_; }
+    };
+
+    return acquire_awaiter{*this, deadline};
+  }
+
+  auto acquire() { return acquire_until(simulation::duration::max()); }
+
+  // Hand the permit to a waiter directly
+  void release() {
+    if (waiters_.empty()) {
+      ++count_;
+      return;
+    }
+    waiter* w;
+    if (policy_ == policy::fifo) {
+      w = waiters_.front();
+      waiters_.pop_front();
+    } else {
+      w = waiters_.back();
+      waiters_.pop_back();
+    }
+    w->granted_ = true;
+    auto& sim = simulation::current();
+    if (w->ticket_) {
+      sim.cancel(*w->ticket_);
+    }
+    sim.schedule(w->handle_);
+  }
+
+ private:
+  struct waiter {
+    std::coroutine_handle<> handle_;
+    std::optional<uint64_t> ticket_;
+    bool granted_ = false;
+  };
+
+  size_t count_;
+  policy policy_;
+  std::list<waiter*> waiters_;
+};
+
+//
+// The tasks of step 10, on virtual time
+//
+
+awaitable<int> mock_heavy_func(int x) {
+  co_await sleep_for(x * 1ms);
+  co_return x;
+}
+
+awaitable<int> simple_func(int x) {
+  auto value = co_await mock_heavy_func(x);
+  std::cout << "[simple_func] Complete at " << simulation::current().now() / 1ms << "ms" << std::endl;
+  co_return value + 1;
+}
+
+awaitable<int> complex_func() {
+  auto await1 = simple_func(100);
+  auto await2 = simple_func(500);
+  auto await3 = simple_func(1000);
+  auto await4 = simple_func(2000);
+  auto value = co_await await1 + co_await await2 + co_await await3 + co_await await4;
+  co_return value;
+}
+
+//
+// Load test: clients with timeouts and retries against a server with limited concurrency
+//
+
+struct load_config {
+  size_t num_requests;
+  double arrival_rate;  // Requests per second, Poisson
+  size_t workers;
+  double service_ms;  // The median of the log-normal service time
+  simulation::duration timeout;
+  int max_retries;
+};
+
+struct load_metrics {
+  std::vector<int64_t> latencies;  // ns, the successful requests only
+  size_t failures = 0;
+  size_t attempts = 0;
+  size_t timeouts = 0;  // Timed out in the queue
+};
+
+class server {
+ public:
+  server(const load_config& config, sim_semaphore::policy p, load_metrics& metrics)
+      : config_(config), workers_(config.workers, p), metrics_(metrics), service_(std::log(config.service_ms), 0.5) {}
+
+  // True when it's done before the deadline. The request leaves the queue at the deadline.
+  awaitable<bool> handle(simulation::duration deadline) {
+    auto& sim = simulation::current();
+    if (!co_await workers_.acquire_until(deadline)) {
+      ++metrics_.timeouts;
+      co_return false;
+    }
+    co_await sleep_for(std::chrono::duration_cast<simulation::duration>(
+        std::chrono::duration<double, std::milli>(service_(sim.rng()))));
+    workers_.release();
+    co_return sim.now() <= deadline;
+  }
+
+ private:
+  const load_config& config_;
+  sim_semaphore workers_;
+  load_metrics& metrics_;
+  std::lognormal_distribution<double> service_;
+};
+
+awaitable<int> client(server& s, const load_config& config, load_metrics& metrics) {
+  auto& sim = simulation::current();
+  auto start = sim.now();
+  for (int attempt = 0; attempt <= config.max_retries; ++attempt) {
+    ++metrics.attempts;
+    if (co_await s.handle(sim.now() + config.timeout)) {
+      metrics.latencies.push_back((sim.now() - start).count());
+      co_return 1;
+    }
+    // Exponential backoff with jitter
+    std::uniform_int_distribution<int64_t> jitter(0, (10ms * (1 << attempt)).count());
+    co_await sleep_for(simulation::duration(jitter(sim.rng())));
+  }
+  ++metrics.failures;
+  co_return 0;
+}
+
+awaitable<int> load_generator(server& s, const load_config& config, load_metrics& metrics) {
+  auto& sim = simulation::current();
+  std::exponential_distribution<double> interval(config.arrival_rate);
+  for (size_t i = 0; i < config.num_requests; ++i) {
+    co_await sleep_for(std::chrono::duration_cast<simulation::duration>(
+        std::chrono::duration<double>(interval(sim.rng()))));
+    sim.start(client(s, config, metrics));
+  }
+  co_return 0;
+}
+
+struct load_result {
+  double wall_ms;
+  double virtual_s;
+  uint64_t resumes;
+  double p50_ms, p99_ms;
+  double success;
+  size_t attempts, timeouts;
+};
+
+load_result run_load(const load_config& config, sim_semaphore::policy p, uint64_t seed) {
+  auto wall_start = std::chrono::steady_clock::now();
+  simulation sim(seed);
+  load_metrics metrics;
+  server s(config, p, metrics);
+  spawn(load_generator(s, config, metrics), sim);
+  sim.run();  // The clients started last
+  auto wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+  auto& l = metrics.latencies;
+  auto percentile = [&l](double q) {
+    if (l.empty()) {
+      return 0.0;
+    }
+    auto it = l.begin() + static_cast<ptrdiff_t>(q * double(l.size() - 1));
+    std::nth_element(l.begin(), it, l.end());
+    return double(*it) / 1e6;
+  };
+  return {wall_ms,
+          std::chrono::duration<double>(sim.now()).count(),
+          sim.resumes(),
+          percentile(0.5),
+          percentile(0.99),
+          double(l.size()) / double(config.num_requests),
+          metrics.attempts,
+          metrics.timeouts};
+}
+
+int main() {
+  //
+  // Usage 1: complex_func of step 10 takes 3.6s of real time there
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  {
+    simulation sim(0);
+    auto wall_start = std::chrono::steady_clock::now();
+    auto result = spawn(complex_func(), sim);
+    auto wall_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - wall_start).count();
+    std::cout << "result:" << result << " virtual:" << sim.now() / 1ms << "ms wall:" << (wall_us < 1000 ? "<1ms" : ">=1ms")
+              << std::endl;
+  }
+  //
+  // Usage 2: Deadlock
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  try {
+    simulation sim(0);
+    sim_semaphore sem(0, sim_semaphore::policy::fifo);
+    spawn([](sim_semaphore& sem) -> awaitable<int> {
+      co_await sem.acquire();  // Nobody releases it
+      co_return 0;
+    }(sem), sim);
+  } catch (const std::logic_error& e) {
+    std::cout << "main: caught " << e.what() << std::endl;
+  }
+  //
+  // Benchmark: 1e6 requests, FIFO vs LIFO queueing at 90% and 110% of the capacity
+  //
+  std::cout << "[+] Benchmark" << std::endl;
+  bool reproducible = true;
+  for (double load : {0.9, 1.1}) {
+    // 100 workers and about 11.3ms mean service time (median 10ms), about 8850 requests/s
+    load_config config{1000000, 8850 * load, 100, 10, 200ms, 2};
+    for (auto p : {sim_semaphore::policy::fifo, sim_semaphore::policy::lifo}) {
+      auto r = run_load(config, p, 42);
+      std::cout << "load " << load << (p == sim_semaphore::policy::fifo ? " fifo" : " lifo") << ": virtual "
+                << r.virtual_s << "s, wall " << r.wall_ms << "ms, " << r.resumes << " resumes | success "
+                << r.success * 100 << "%, p50 " << r.p50_ms << "ms, p99 " << r.p99_ms << "ms, attempts " << r.attempts
+                << ", queue timeouts " << r.timeouts << std::endl;
+      if (load > 1 && p == sim_semaphore::policy::lifo) {
+        auto again = run_load(config, p, 42);
+        reproducible = again.p99_ms == r.p99_ms && again.attempts == r.attempts && again.resumes == r.resumes;
+      }
+    }
+  }
+  std::cout << "reproducible with the same seed: " << (reproducible ? "yes" : "no") << std::endl;
+  return reproducible ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the wall time varies by machine):
+[+] Usage1
+[simple_func] Complete at 100ms
+[simple_func] Complete at 600ms
+[simple_func] Complete at 1600ms
+[simple_func] Complete at 3600ms
+result:3604 virtual:3600ms wall:<1ms
+[+] Usage2
+main: caught simulation: deadlock, the task is not done and nothing could run
+[+] Benchmark
+load 0.9 fifo: virtual 125.9s, wall 659.1ms, 5214043 resumes | success 100%, p50 10.2ms, p99 32.4ms, attempts 1000000, queue timeouts 0
+load 0.9 lifo: virtual 125.9s, wall 502.2ms, 5214043 resumes | success 100%, p50 10.1ms, p99 33.0ms, attempts 1000000, queue timeouts 0
+load 1.1 fifo: virtual 103.3s, wall 2078.6ms, 14605844 resumes | success 1.6%, p50 109.5ms, p99 198.3ms, attempts 2967379, queue timeouts 2055122
+load 1.1 lifo: virtual 103.1s, wall 1243.3ms, 8121672 resumes | success 90.8%, p50 13.5ms, p99 418.9ms, attempts 1541428, queue timeouts 633298
+reproducible with the same seed: yes
+*/
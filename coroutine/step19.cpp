@@ -0,0 +1,458 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 18:05:42
+ *
+ * File Name: step19.cpp
+ * Description:
+ *
+ *  Step 19: An error channel without exceptions
+ *  - The awaitable of step 10 reports errors by unhandled_exception, and every co_await level rethrows. For errors
+ *    on the hot path (not found, timeout) that's a throw and an unwind per level.
+ *  - awaitable<std::expected<T, E>> carries the error as a value: `co_return std::unexpected(e)` is a plain return.
+ *  - `co_await try_(task)` is the `?` of Rust: it gives the value of task, or when task fails, the error completes
+ *    the awaiting coroutine too, without resuming it. The error goes up through all the try_ levels at once, and
+ *    only the first plain `co_await` is resumed to look at the error. The skipped frames are destroyed by their
+ *    awaitable as usual.
+ *  - Changes to the awaitable of step 10: await_suspend accepts any caller promise, a moved awaitable doesn't destroy
+ *    the handle, value() and await_resume() are not noexcept any more (they rethrow), and done() is true when the
+ *    promise is completed, since a failed coroutine never reaches its final suspend.
+ *
+ */
+
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <expected>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <semaphore>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+//
+// The awaitable of step 10, with the error channel
+//
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+template <typename T>
+struct is_expected : std::false_type {};
+
+template <typename T, typename E>
+struct is_expected<std::expected<T, E>> : std::true_type {};
+
+// The error type of std::expected, or a placeholder for the others
+template <typename T>
+struct error_type_of {
+  using type = std::monostate;
+};
+
+template <typename T, typename E>
+struct error_type_of<std::expected<T, E>> {
+  using type = E;
+};
+
+template <typename T>
+using error_type = typename error_type_of<T>::type;
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept {
+      complete();
+      return {};
+    }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    // Complete with an error without running the rest of the body, the frame stays suspended until it's destroyed
+    template <typename E>
+      requires is_expected<T>::value
+    void fail(E&& error) {
+      value_ = std::unexpected(std::forward<E>(error));
+      complete();
+    }
+
+    // Set by try_(): an error is passed to the caller's promise instead of resuming the caller
+    template <typename Promise>
+      requires is_expected<T>::value
+    void set_error_sink(Promise& caller) {
+      error_target_ = &caller;
+      error_sink_ = [](void* target, const typename T::error_type& error) {
+        static_cast<Promise*>(target)->fail(error);
+      };
+    }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    void complete() noexcept {
+      completed_ = true;
+      if constexpr (is_expected<T>::value) {
+        if (error_sink_ && value_ && !value_->has_value()) {
+          // Skip the caller, the error goes up until a plain co_await
+          error_sink_(error_target_, value_->error());
+          return;
+        }
+      }
+      if (spawn_ && caller_handle_) {
+        // The callee is completed, and we should schedule the await_resume of caller. (by calling caller_handle())
+        spawn_(caller_handle_);
+      }
+    }
+
+    // Completed by the end of the body or by fail()
+    bool completed_ = false;
+
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+    // The caller's promise and its fail(), when awaited by try_()
+    void* error_target_ = nullptr;
+    void (*error_sink_)(void*, const error_type<T>&) = nullptr;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    // Progragate spawn function from caller to callee and set caller. We can then call spawn_(caller_handle) to resume
+    // the caller later.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    promise.set_spawn(h.promise().get_spawn());
+  }
+
+  T& await_resume() { return value(); }
+
+  bool done() noexcept { return handle_.promise().completed_; }
+
+  T& value() {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  template <typename Task>
+  friend class try_awaiter;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// try_
+//
+
+template <typename Task>
+class try_awaiter {
+ public:
+  explicit try_awaiter(Task task) : task_(std::forward<Task>(task)) {}
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    // An error of the task fails the caller's promise directly
+    task_.handle_.promise().set_error_sink(h.promise());
+    task_.await_suspend(h);
+  }
+
+  // Only resumed on success
+  decltype(auto) await_resume() { return *task_.value(); }
+
+ private:
+  Task task_;
+};
+
+template <typename T, typename E>
+try_awaiter<awaitable<std::expected<T, E>>&> try_(awaitable<std::expected<T, E>>& task) {
+  return try_awaiter<awaitable<std::expected<T, E>>&>(task);
+}
+
+template <typename T, typename E>
+try_awaiter<awaitable<std::expected<T, E>>> try_(awaitable<std::expected<T, E>>&& task) {
+  return try_awaiter<awaitable<std::expected<T, E>>>(std::move(task));
+}
+
+//
+// A simple scheduler
+//
+
+template <typename T>
+T spawn(awaitable<T>&& task) {
+  //
+  // Handle queue and spawn function
+  //
+  std::mutex m;
+  std::counting_semaphore queue_size{0};
+  std::queue<std::coroutine_handle<>> h_queue;
+  spawn_function spawn = [&m, &queue_size, &h_queue](std::coroutine_handle<> h) {
+    {
+      std::lock_guard lock(m);
+      h_queue.emplace(h);
+    }
+    queue_size.release();
+  };
+
+  // Set spawn function (And will actually run the function)
+  task.set_spawn(spawn);
+
+  //
+  // Run handles (Yes, we can implement it in a multi-thread way, it's quite easy to do that)
+  //
+  //  For an industrial implementation, we must consider the following things:
+  //
+  //    1. Cancellation
+  //    2. Effective way to enqueue / dequeue
+  //    3. Dead lock detection
+  //    4. ...
+  //
+  //  Remember: this is just a very simple prototype.
+  //
+  while (!task.done()) {
+    // When all coroutines of current scheduler are suspend. The scheduler should wait for any coroutine becoming ready
+    // to continue (e.g. data received from a socket, user input a string, ...).
+    queue_size.acquire();
+    // Run handles
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard lock(m);
+      handle = h_queue.front();
+      h_queue.pop();
+    }
+    handle();
+  }
+
+  return task.value();
+}
+
+//
+// Test
+//
+
+enum class lookup_error { not_found, timeout };
+
+const char* to_string(lookup_error error) { return error == lookup_error::not_found ? "not_found" : "timeout"; }
+
+using lookup_result = std::expected<int, lookup_error>;
+
+// The same 10 levels chain in 3 ways, the leaf fails when asked to
+
+awaitable<int> chain_throw(int depth, bool fail) {
+  if (depth == 0) {
+    if (fail) {
+      throw std::runtime_error("not_found");
+    }
+    co_return 1;
+  }
+  co_return co_await chain_throw(depth - 1, fail) + 1;
+}
+
+awaitable<lookup_result> chain_check(int depth, bool fail) {
+  if (depth == 0) {
+    if (fail) {
+      co_return std::unexpected(lookup_error::not_found);
+    }
+    co_return 1;
+  }
+  auto result = co_await chain_check(depth - 1, fail);
+  if (!result) {
+    co_return std::unexpected(result.error());
+  }
+  co_return *result + 1;
+}
+
+awaitable<lookup_result> chain_try(int depth, bool fail) {
+  if (depth == 0) {
+    if (fail) {
+      co_return std::unexpected(lookup_error::not_found);
+    }
+    co_return 1;
+  }
+  co_return co_await try_(chain_try(depth - 1, fail)) + 1;
+}
+
+struct summary {
+  int64_t sum = 0;
+  int failures = 0;
+};
+
+awaitable<summary> run_throw(const std::vector<bool>& fails) {
+  summary s;
+  for (bool fail : fails) {
+    try {
+      s.sum += co_await chain_throw(10, fail);
+    } catch (const std::exception&) {
+      ++s.failures;
+    }
+  }
+  co_return s;
+}
+
+template <awaitable<lookup_result> (*CHAIN)(int, bool)>
+awaitable<summary> run_expected(const std::vector<bool>& fails) {
+  summary s;
+  for (bool fail : fails) {
+    auto result = co_await CHAIN(10, fail);
+    if (result) {
+      s.sum += *result;
+    } else {
+      ++s.failures;
+    }
+  }
+  co_return s;
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  for (bool fail : {false, true}) {
+    auto result = spawn(chain_try(3, fail));
+    std::cout << "chain_try(3, " << fail << "): "
+              << (result ? std::to_string(*result) : std::string("error ") + to_string(result.error())) << std::endl;
+  }
+  //
+  // Benchmark: 10 levels chains, 10% of them fail at the leaf. All of them fail in the second round, to see the cost
+  // of the error path alone.
+  //
+  constexpr size_t num_chains = 100000;
+  bool ok = true;
+  for (int percent : {10, 100}) {
+    std::mt19937 rng(42);
+    std::vector<bool> fails(num_chains);
+    for (size_t i = 0; i < num_chains; ++i) {
+      fails[i] = int(rng() % 100) < percent;
+    }
+    summary s1, s2, s3;
+    auto throw_ns = measure([&] { s1 = spawn(run_throw(fails)); });
+    auto check_ns = measure([&] { s2 = spawn(run_expected<chain_check>(fails)); });
+    auto try_ns = measure([&] { s3 = spawn(run_expected<chain_try>(fails)); });
+    std::cout << "[+] Benchmark: " << num_chains << " chains of 10 levels, " << s1.failures << " failed (ns/chain)"
+              << std::endl;
+    std::cout << "exception: " << throw_ns / num_chains << std::endl;
+    std::cout << "expected, checked per level: " << check_ns / num_chains << std::endl;
+    std::cout << "expected, try_: " << try_ns / num_chains << std::endl;
+    ok = ok && s1.sum == s2.sum && s2.sum == s3.sum && s1.failures == s2.failures && s2.failures == s3.failures;
+  }
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+chain_try(3, 0): 4
+chain_try(3, 1): error not_found
+[+] Benchmark: 100000 chains of 10 levels, 9964 failed (ns/chain)
+exception: 9603.6
+expected, checked per level: 7534.3
+expected, try_: 6886.0
+[+] Benchmark: 100000 chains of 10 levels, 100000 failed (ns/chain)
+exception: 26691.6
+expected, checked per level: 6484.5
+expected, try_: 4238.6
+OK
+
+NOTE: Most of a chain is the hops through the scheduler of step 10 (a mutex, a semaphore and a std::function per
+resume), which are the same for all of them. A failed chain costs ~2us per level with exceptions, the error as a
+value costs nothing more than a success, and try_ skips the resumes of the 9 levels in between.
+*/
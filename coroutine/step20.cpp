@@ -0,0 +1,509 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 19:32:15
+ *
+ * File Name: step20.cpp
+ * Description:
+ *
+ *  Step 20: Synchronous completion
+ *  - The awaitable of step 10 always suspends the caller: await_ready is false, and the callee is started by a hop
+ *    through the scheduler, and the caller is resumed by another hop. Even a cache hit, which returns at once, costs
+ *    two hops.
+ *  - Here await_ready is true when the callee is done, so awaiting a completed task (e.g. started before) is just a
+ *    result read. A callee which has not started is resumed inline in await_suspend, and when it completes there,
+ *    await_suspend returns false and the caller continues with no hop at all. Only a callee that really suspends
+ *    (I/O, timers, ...) resumes the caller through the scheduler.
+ *  - The caller and final_suspend of callee both "arrive" on an atomic state, the second one continues the caller, so
+ *    it's still correct when the callee completes on another thread while the caller is suspending. await_ready and
+ *    done() read the arrival of final_suspend (acquire) rather than handle.done(), which races with that thread.
+ *  - The awaitable of step 10 is kept in namespace baseline for the benchmark, both with the changes of step 18:
+ *    await_suspend accepts any caller promise, and a moved awaitable doesn't destroy the handle.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <semaphore>
+#include <utility>
+#include <vector>
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+//
+// The awaitable of step 10
+//
+
+namespace baseline {
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    std::suspend_always final_suspend() noexcept {
+      if (spawn_ && caller_handle_) {
+        // The callee is completed, and we should schedule the await_resume of caller. (by calling caller_handle())
+        spawn_(caller_handle_);
+      }
+      return {};
+    }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    // Progragate spawn function from caller to callee and set caller. We can then call spawn_(caller_handle) to resume
+    // the caller later.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    promise.set_spawn(h.promise().get_spawn());
+  }
+
+  T& await_resume() noexcept { return value(); }
+
+  bool done() noexcept { return handle_.done(); }
+
+  T& value() noexcept {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+}  // namespace baseline
+
+//
+// The awaitable with synchronous completion
+//
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Spawn the caller when current coroutine has suspended, since the caller may destroy the frame at once on
+    // another thread
+    struct final_awaiter {
+      constexpr bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        auto& promise = h.promise();
+        // The caller is only resumed by us when it has suspended, otherwise it's still in await_suspend and continues
+        if (promise.arrive_final() && promise.spawn_ && promise.caller_handle_) {
+          // The callee is completed, and we should schedule the await_resume of caller. Nothing of the frame is
+          // touched after that.
+          auto spawn = promise.spawn_;
+          spawn(promise.caller_handle_);
+        }
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    // Run the coroutine from initial_suspend on the current thread, until it completes or suspends
+    void start_inline(spawn_function f) {
+      spawn_ = std::move(f);
+      init_spawned_ = true;
+      std::coroutine_handle<promise_type>::from_promise(*this).resume();
+    }
+
+    bool started() const noexcept { return init_spawned_; }
+
+    // The caller (after setting itself) and final_suspend both arrive, the second one resumes the caller. Each returns
+    // whether the other one has arrived.
+    bool arrive_caller() noexcept {
+      return arrived_.fetch_or(caller_arrived, std::memory_order_acq_rel) & final_arrived;
+    }
+
+    bool arrive_final() noexcept {
+      return arrived_.fetch_or(final_arrived, std::memory_order_acq_rel) & caller_arrived;
+    }
+
+    // Whether final_suspend has arrived, the result is visible then. handle_.done() can't tell it on another thread,
+    // it's not synchronized with the thread running the callee.
+    bool completed() const noexcept { return arrived_.load(std::memory_order_acquire) & final_arrived; }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Whether the caller or final_suspend has arrived
+    static constexpr uint8_t caller_arrived = 1;
+    static constexpr uint8_t final_arrived = 2;
+    std::atomic<uint8_t> arrived_ = 0;
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  // A completed callee is just a result read
+  bool await_ready() const noexcept { return handle_.promise().completed(); }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    // Set caller, and run a callee which has not started yet right here instead of a hop through the scheduler. The
+    // spawn function of caller is propagated to callee. A callee which was started before keeps its spawn function.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    if (!promise.started()) {
+      promise.start_inline(h.promise().get_spawn());
+    }
+    // Returning false continues the caller right now: the callee has completed synchronously (or meanwhile on another
+    // thread). Otherwise the callee will spawn the caller in final_suspend.
+    return !promise.arrive_caller();
+  }
+
+  T& await_resume() noexcept { return value(); }
+
+  bool done() noexcept { return handle_.promise().completed(); }
+
+  T& value() noexcept {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// A simple scheduler of step 10, counting the hops
+//
+
+size_t scheduler_hops = 0;
+
+template <template <typename> class Awaitable, typename T>
+T spawn(Awaitable<T>&& task) {
+  std::mutex m;
+  std::counting_semaphore queue_size{0};
+  std::queue<std::coroutine_handle<>> h_queue;
+  spawn_function spawn = [&m, &queue_size, &h_queue](std::coroutine_handle<> h) {
+    {
+      std::lock_guard lock(m);
+      h_queue.emplace(h);
+    }
+    queue_size.release();
+  };
+
+  task.set_spawn(spawn);
+
+  while (!task.done()) {
+    queue_size.acquire();
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard lock(m);
+      handle = h_queue.front();
+      h_queue.pop();
+    }
+    ++scheduler_hops;
+    handle();
+  }
+
+  return task.value();
+}
+
+// Suspend and get scheduled again, as an I/O completion would
+struct reschedule {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    h.promise().get_spawn()(h);
+  }
+
+  void await_resume() noexcept {}
+};
+
+// The spawn function of current coroutine
+struct this_spawn {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    spawn_ = h.promise().get_spawn();
+    return false;
+  }
+
+  spawn_function await_resume() noexcept { return std::move(spawn_); }
+
+  spawn_function spawn_;
+};
+
+//
+// Test
+//
+
+// A cache in front of a slow backend
+template <template <typename> class Awaitable>
+Awaitable<int> fetch(int key) {
+  co_await reschedule{};
+  co_return key * 2;
+}
+
+template <template <typename> class Awaitable>
+Awaitable<int> lookup(const std::vector<int>& cache, int key) {
+  if (cache[key] >= 0) {
+    co_return cache[key];
+  }
+  co_return co_await fetch<Awaitable>(key);
+}
+
+template <template <typename> class Awaitable>
+Awaitable<int64_t> run(const std::vector<int>& cache, const std::vector<int>& keys) {
+  int64_t sum = 0;
+  for (int key : keys) {
+    sum += co_await lookup<Awaitable>(cache, key);
+  }
+  co_return sum;
+}
+
+// A task started before it's awaited
+awaitable<int> prefetch() {
+  auto spawn = co_await this_spawn{};
+  auto task = fetch<awaitable>(21);
+  task.set_spawn(spawn);
+  co_await reschedule{};
+  co_await reschedule{};
+  std::cout << "prefetched task is done before co_await: " << task.done() << std::endl;
+  co_return co_await task;
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  auto result = spawn(prefetch());
+  std::cout << "result: " << result << std::endl;
+  //
+  // Benchmark: 1e6 lookups, 95% of them hit the cache
+  //
+  constexpr int num_keys = 1000;
+  constexpr size_t num_lookups = 1000000;
+  std::mt19937 rng(42);
+  std::vector<int> cache(num_keys);
+  for (int key = 0; key < num_keys; ++key) {
+    cache[key] = rng() % 100 < 95 ? key * 2 : -1;
+  }
+  std::vector<int> keys(num_lookups);
+  for (auto& key : keys) {
+    key = rng() % num_keys;
+  }
+  int64_t sum1 = 0, sum2 = 0;
+  scheduler_hops = 0;
+  auto baseline_ns = measure([&] { sum1 = spawn(run<baseline::awaitable>(cache, keys)); });
+  auto baseline_hops = scheduler_hops;
+  scheduler_hops = 0;
+  auto fast_ns = measure([&] { sum2 = spawn(run<awaitable>(cache, keys)); });
+  auto fast_hops = scheduler_hops;
+  std::cout << "[+] Benchmark: " << num_lookups << " lookups, 95% cache hits" << std::endl;
+  std::cout << "step 10 awaitable: " << baseline_ns / num_lookups << "ns/lookup, "
+            << double(baseline_hops) / num_lookups << " hops/lookup" << std::endl;
+  std::cout << "synchronous completion: " << fast_ns / num_lookups << "ns/lookup, " << double(fast_hops) / num_lookups
+            << " hops/lookup" << std::endl;
+  bool ok = sum1 == sum2;
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+prefetched task is done before co_await: 1
+result: 42
+[+] Benchmark: 1000000 lookups, 95% cache hits
+step 10 awaitable: 709.5ns/lookup, 2.13567 hops/lookup
+synchronous completion: 106.7ns/lookup, 0.135673 hops/lookup
+OK
+*/
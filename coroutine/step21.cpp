@@ -0,0 +1,614 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 21:14:36
+ *
+ * File Name: step21.cpp
+ * Description:
+ *
+ *  Step 21: A shared task, awaited by many coroutines
+ *  - The promise of awaitable stores one caller, so a result cannot be awaited by several coroutines, and each of
+ *    them starts its own computation.
+ *  - shared_task<T> is reference counted, and it's started by the first awaiter (inline, as step 20). The awaiters
+ *    push themselves into an intrusive lock-free list (the nodes live in the awaiters' frames), and when the task
+ *    completes, the list is swapped with a "completed" mark and all of them are spawned with their own spawn
+ *    function. An awaiter who comes later sees the mark and reads the result without suspending.
+ *  - The list is notified in the await_suspend of final_suspend, when the frame is suspended already, since a waiter
+ *    may drop the last reference on another thread.
+ *  - single_flight_cache memoizes a shared_task per key: a thundering herd of requests for the same key costs one
+ *    call to the backend.
+ *  - The awaitable is the one of step 20.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <semaphore>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+//
+// The awaitable of step 20
+//
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Spawn the caller when current coroutine has suspended, since the caller may destroy the frame at once on
+    // another thread
+    struct final_awaiter {
+      constexpr bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        auto& promise = h.promise();
+        // The caller is only resumed by us when it has suspended, otherwise it's still in await_suspend and continues
+        if (promise.arrive_final() && promise.spawn_ && promise.caller_handle_) {
+          // The callee is completed, and we should schedule the await_resume of caller. Nothing of the frame is
+          // touched after that.
+          auto spawn = promise.spawn_;
+          spawn(promise.caller_handle_);
+        }
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    // Run the coroutine from initial_suspend on the current thread, until it completes or suspends
+    void start_inline(spawn_function f) {
+      spawn_ = std::move(f);
+      init_spawned_ = true;
+      std::coroutine_handle<promise_type>::from_promise(*this).resume();
+    }
+
+    bool started() const noexcept { return init_spawned_; }
+
+    // The caller (after setting itself) and final_suspend both arrive, the second one resumes the caller. Each returns
+    // whether the other one has arrived.
+    bool arrive_caller() noexcept {
+      return arrived_.fetch_or(caller_arrived, std::memory_order_acq_rel) & final_arrived;
+    }
+
+    bool arrive_final() noexcept {
+      return arrived_.fetch_or(final_arrived, std::memory_order_acq_rel) & caller_arrived;
+    }
+
+    // Whether final_suspend has arrived, the result is visible then. handle_.done() can't tell it on another thread,
+    // it's not synchronized with the thread running the callee.
+    bool completed() const noexcept { return arrived_.load(std::memory_order_acquire) & final_arrived; }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Whether the caller or final_suspend has arrived
+    static constexpr uint8_t caller_arrived = 1;
+    static constexpr uint8_t final_arrived = 2;
+    std::atomic<uint8_t> arrived_ = 0;
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  // A completed callee is just a result read
+  bool await_ready() const noexcept { return handle_.promise().completed(); }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    // Set caller, and run a callee which has not started yet right here instead of a hop through the scheduler. The
+    // spawn function of caller is propagated to callee. A callee which was started before keeps its spawn function.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    if (!promise.started()) {
+      promise.start_inline(h.promise().get_spawn());
+    }
+    // Returning false continues the caller right now: the callee has completed synchronously (or meanwhile on another
+    // thread). Otherwise the callee will spawn the caller in final_suspend.
+    return !promise.arrive_caller();
+  }
+
+  T& await_resume() noexcept { return value(); }
+
+  bool done() noexcept { return handle_.promise().completed(); }
+
+  T& value() noexcept {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// Shared task
+//
+
+template <typename T>
+class shared_task {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    shared_task get_return_object() {
+      return shared_task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    struct final_awaiter {
+      constexpr bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept { h.promise().notify(); }
+
+      void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    // The spawn function of the first awaiter
+    spawn_function get_spawn() { return spawn_; }
+
+   private:
+    friend shared_task;
+
+    // An awaiting coroutine, in the frame of it
+    struct waiter {
+      std::coroutine_handle<> handle;
+      spawn_function spawn;
+      waiter* next = nullptr;
+    };
+
+    // Only the first caller starts the task
+    bool try_start() noexcept { return !started_.exchange(true, std::memory_order_acq_rel); }
+
+    bool completed() const noexcept { return waiters_.load(std::memory_order_acquire) == completed_mark(); }
+
+    // Push a waiter, or false when the task has completed
+    bool add_waiter(waiter* w) noexcept {
+      void* head = waiters_.load(std::memory_order_acquire);
+      do {
+        if (head == completed_mark()) {
+          return false;
+        }
+        w->next = static_cast<waiter*>(head);
+      } while (!waiters_.compare_exchange_weak(head, w, std::memory_order_acq_rel, std::memory_order_acquire));
+      return true;
+    }
+
+    // Mark completed and spawn all the waiters
+    void notify() noexcept {
+      auto w = static_cast<waiter*>(waiters_.exchange(completed_mark(), std::memory_order_acq_rel));
+      while (w) {
+        // The waiter may be resumed (and its frame destroyed) as soon as it's spawned
+        auto next = w->next;
+        auto spawn = std::move(w->spawn);
+        spawn(w->handle);
+        w = next;
+      }
+    }
+
+    void* completed_mark() const noexcept { return const_cast<promise_type*>(this); }
+
+    std::atomic<bool> started_ = false;
+    // nullptr, the head of waiters or the completed mark
+    std::atomic<void*> waiters_ = nullptr;
+    std::atomic<size_t> references_ = 1;
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+  };
+
+  //
+  // Awaiter
+  //
+
+  class awaiter {
+   public:
+    explicit awaiter(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    bool await_ready() const noexcept { return handle_.promise().completed(); }
+
+    template <typename Promise>
+    bool await_suspend(std::coroutine_handle<Promise> h) {
+      auto& promise = handle_.promise();
+      auto spawn = h.promise().get_spawn();
+      if (promise.try_start()) {
+        promise.spawn_ = spawn;
+        handle_.resume();
+      }
+      waiter_.handle = h;
+      waiter_.spawn = std::move(spawn);
+      // Continue right now when the task has completed
+      return promise.add_waiter(&waiter_);
+    }
+
+    const T& await_resume() const { return shared_task::value(handle_); }
+
+   private:
+    std::coroutine_handle<promise_type> handle_;
+    typename promise_type::waiter waiter_;
+  };
+
+  //
+  // Shared task
+  //
+
+  shared_task(const shared_task& other) noexcept : handle_(other.handle_) {
+    if (handle_) {
+      handle_.promise().references_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  shared_task(shared_task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+
+  shared_task& operator=(shared_task other) noexcept {
+    std::swap(handle_, other.handle_);
+    return *this;
+  }
+
+  ~shared_task() noexcept {
+    if (handle_ && handle_.promise().references_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      handle_.destroy();
+    }
+  }
+
+  awaiter operator co_await() const noexcept { return awaiter(handle_); }
+
+  bool done() const noexcept { return handle_.promise().completed(); }
+
+  const T& value() const { return value(handle_); }
+
+ private:
+  explicit shared_task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  static const T& value(std::coroutine_handle<promise_type> handle) {
+    auto& promise = handle.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// Single flight cache
+//
+
+template <typename K, typename V>
+class single_flight_cache {
+ public:
+  using loader_function = std::function<awaitable<V>(const K&)>;
+
+  explicit single_flight_cache(loader_function loader) : loader_(std::move(loader)) {}
+
+  // The task of the key, which is loaded by the first awaiter only. A failed load is memoized as well.
+  shared_task<V> get(const K& key) {
+    std::lock_guard lock(m_);
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      it = entries_.emplace(key, load(loader_(key))).first;
+    }
+    return it->second;
+  }
+
+ private:
+  static shared_task<V> load(awaitable<V> task) { co_return co_await task; }
+
+  loader_function loader_;
+  std::mutex m_;
+  std::unordered_map<K, shared_task<V>> entries_;
+};
+
+//
+// A simple scheduler of step 10, counting the hops (of current thread)
+//
+
+thread_local size_t scheduler_hops = 0;
+
+template <template <typename> class Awaitable, typename T>
+T spawn(Awaitable<T>&& task) {
+  std::mutex m;
+  std::counting_semaphore queue_size{0};
+  std::queue<std::coroutine_handle<>> h_queue;
+  spawn_function spawn = [&m, &queue_size, &h_queue](std::coroutine_handle<> h) {
+    {
+      std::lock_guard lock(m);
+      h_queue.emplace(h);
+    }
+    queue_size.release();
+  };
+
+  task.set_spawn(spawn);
+
+  while (!task.done()) {
+    queue_size.acquire();
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard lock(m);
+      handle = h_queue.front();
+      h_queue.pop();
+    }
+    ++scheduler_hops;
+    handle();
+  }
+
+  return task.value();
+}
+
+// Suspend and get scheduled again, as an I/O completion would
+struct reschedule {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    h.promise().get_spawn()(h);
+  }
+
+  void await_resume() noexcept {}
+};
+
+// The spawn function of current coroutine
+struct this_spawn {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    spawn_ = h.promise().get_spawn();
+    return false;
+  }
+
+  spawn_function await_resume() noexcept { return std::move(spawn_); }
+
+  spawn_function spawn_;
+};
+
+//
+// Test
+//
+
+// A slow backend, counting the calls
+struct backend {
+  std::atomic<size_t> calls = 0;
+
+  awaitable<std::string> load(int key) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < 3; ++i) {
+      co_await reschedule{};
+    }
+    co_return "value-" + std::to_string(key);
+  }
+};
+
+// Check and fill, the requests of a key before the first fill all go to the backend
+class naive_cache {
+ public:
+  explicit naive_cache(backend& b) : backend_(b) {}
+
+  awaitable<std::string> get(int key) {
+    if (auto it = entries_.find(key); it != entries_.end()) {
+      co_return it->second;
+    }
+    auto value = co_await backend_.load(key);
+    entries_.emplace(key, value);
+    co_return value;
+  }
+
+ private:
+  backend& backend_;
+  std::unordered_map<int, std::string> entries_;
+};
+
+template <typename Cache>
+awaitable<size_t> client(Cache& cache, int key) {
+  // A copy, the value of an awaitable dies with it
+  std::string value = co_await cache.get(key);
+  co_return value.size();
+}
+
+// All the clients are started at once
+template <typename Cache>
+awaitable<size_t> herd(Cache& cache, const std::vector<int>& keys) {
+  auto spawn = co_await this_spawn{};
+  std::vector<awaitable<size_t>> clients;
+  clients.reserve(keys.size());
+  for (int key : keys) {
+    clients.push_back(client(cache, key));
+    clients.back().set_spawn(spawn);
+  }
+  size_t total = 0;
+  for (auto& c : clients) {
+    total += co_await c;
+  }
+  co_return total;
+}
+
+awaitable<std::string> late_awaiter(shared_task<std::string> task) {
+  auto hops = scheduler_hops;
+  const std::string& first = co_await task;
+  std::cout << "first co_await: " << first << ", " << scheduler_hops - hops << " hops" << std::endl;
+  hops = scheduler_hops;
+  const std::string& second = co_await task;
+  std::cout << "late co_await: " << second << ", " << scheduler_hops - hops << " hops" << std::endl;
+  co_return second;
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  bool ok = true;
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  {
+    backend b;
+    single_flight_cache<int, std::string> cache([&b](const int& key) { return b.load(key); });
+    spawn(late_awaiter(cache.get(7)));
+    // 4 schedulers on their own threads await the same key
+    std::vector<std::thread> threads;
+    std::atomic<size_t> total = 0;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&] { total += spawn(herd(cache, std::vector<int>(250, 42))); });
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+    std::cout << "4 threads x 250 clients of one key: " << b.calls - 1 << " backend call" << std::endl;
+    ok = ok && b.calls == 2 && total == 1000 * std::string("value-42").size();
+  }
+  //
+  // Benchmark: a thundering herd of 1000 clients over 16 keys
+  //
+  constexpr size_t num_clients = 1000;
+  std::mt19937 rng(42);
+  std::vector<int> keys(num_clients);
+  for (auto& key : keys) {
+    key = rng() % 16;
+  }
+  backend naive_backend, single_flight_backend;
+  naive_cache naive(naive_backend);
+  single_flight_cache<int, std::string> single_flight(
+      [&single_flight_backend](const int& key) { return single_flight_backend.load(key); });
+  size_t total1 = 0, total2 = 0;
+  auto naive_us = measure([&] { total1 = spawn(herd(naive, keys)); });
+  auto single_flight_us = measure([&] { total2 = spawn(herd(single_flight, keys)); });
+  std::cout << "[+] Benchmark: " << num_clients << " clients at once over 16 keys" << std::endl;
+  std::cout << "check and fill: " << naive_backend.calls << " backend calls, " << naive_us << "us" << std::endl;
+  std::cout << "single flight: " << single_flight_backend.calls << " backend calls, " << single_flight_us << "us"
+            << std::endl;
+  ok = ok && total1 == total2;
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+first co_await: value-7, 5 hops
+late co_await: value-7, 0 hops
+4 threads x 250 clients of one key: 1 backend call
+[+] Benchmark: 1000 clients at once over 16 keys
+check and fill: 1000 backend calls, 1084.2us
+single flight: 16 backend calls, 419.8us
+OK
+*/
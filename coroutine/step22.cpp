@@ -0,0 +1,1049 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 23:02:51
+ *
+ * File Name: step22.cpp
+ * Description:
+ *
+ *  Step 22: A thread-per-core sharded runtime
+ *  - Each shard is a thread (pinned to a core) running its own loop of the spawn() of step 10, with its own ready
+ *    queue, timers and coroutine frame pool. Nothing of a shard is touched by other threads.
+ *  - Work crosses shards only by `co_await on_shard(n, fn)`: a message is sent to shard n through the SPSC queue of
+ *    the pair (current, n), fn runs there (it may return an awaitable), and the result comes back the same way to
+ *    resume the caller on its own shard. A message that doesn't fit into a full queue waits in a backlog of the
+ *    sender, so a shard never blocks on sending.
+ *  - An idle shard sleeps on a condition variable. The sender checks the sleeping flag after a fence, and only takes
+ *    the lock to wake it up, so the hot path has no locks and no shared writes besides the queue itself.
+ *  - The benchmark compares a sharded key-value store with a single shared queue of coroutines served by the same
+ *    number of threads, and one locked map.
+ *  - The awaitable is the one of step 20, with frames allocated from the frame pool.
+ *
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <semaphore>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std::chrono_literals;
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+//
+// Frame pool, a free list per size class of current thread
+//
+
+namespace frame_pool {
+
+constexpr size_t granularity = 64;
+constexpr size_t num_classes = 32;
+
+struct node {
+  node* next;
+};
+
+struct free_lists {
+  std::array<node*, num_classes> heads{};
+
+  ~free_lists() {
+    for (auto head : heads) {
+      while (head) {
+        ::operator delete(std::exchange(head, head->next));
+      }
+    }
+  }
+};
+
+thread_local free_lists lists;
+
+void* allocate(size_t size) {
+  size_t c = (size + granularity - 1) / granularity;
+  if (c >= num_classes) {
+    return ::operator new(size);
+  }
+  if (auto head = lists.heads[c]) {
+    lists.heads[c] = head->next;
+    return head;
+  }
+  return ::operator new(c * granularity);
+}
+
+// A frame freed on another thread goes to the pool of that thread
+void deallocate(void* ptr, size_t size) noexcept {
+  size_t c = (size + granularity - 1) / granularity;
+  if (c >= num_classes) {
+    ::operator delete(ptr);
+    return;
+  }
+  auto n = static_cast<node*>(ptr);
+  n->next = lists.heads[c];
+  lists.heads[c] = n;
+}
+
+}  // namespace frame_pool
+
+//
+// The awaitable of step 20
+//
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Frames are allocated from the pool of current thread (shard)
+    static void* operator new(size_t size) { return frame_pool::allocate(size); }
+
+    static void operator delete(void* ptr, size_t size) noexcept { frame_pool::deallocate(ptr, size); }
+
+    // Spawn the caller when current coroutine has suspended, since the caller may destroy the frame at once on
+    // another thread
+    struct final_awaiter {
+      constexpr bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        auto& promise = h.promise();
+        // The caller is only resumed by us when it has suspended, otherwise it's still in await_suspend and continues
+        if (promise.arrive_final() && promise.spawn_ && promise.caller_handle_) {
+          // The callee is completed, and we should schedule the await_resume of caller. Nothing of the frame is
+          // touched after that.
+          auto spawn = promise.spawn_;
+          spawn(promise.caller_handle_);
+        }
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    // Run the coroutine from initial_suspend on the current thread, until it completes or suspends
+    void start_inline(spawn_function f) {
+      spawn_ = std::move(f);
+      init_spawned_ = true;
+      std::coroutine_handle<promise_type>::from_promise(*this).resume();
+    }
+
+    bool started() const noexcept { return init_spawned_; }
+
+    // The caller (after setting itself) and final_suspend both arrive, the second one resumes the caller. Each returns
+    // whether the other one has arrived.
+    bool arrive_caller() noexcept {
+      return arrived_.fetch_or(caller_arrived, std::memory_order_acq_rel) & final_arrived;
+    }
+
+    bool arrive_final() noexcept {
+      return arrived_.fetch_or(final_arrived, std::memory_order_acq_rel) & caller_arrived;
+    }
+
+    // Whether final_suspend has arrived, the result is visible then. handle_.done() can't tell it on another thread,
+    // it's not synchronized with the thread running the callee.
+    bool completed() const noexcept { return arrived_.load(std::memory_order_acquire) & final_arrived; }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Whether the caller or final_suspend has arrived
+    static constexpr uint8_t caller_arrived = 1;
+    static constexpr uint8_t final_arrived = 2;
+    std::atomic<uint8_t> arrived_ = 0;
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  // A completed callee is just a result read
+  bool await_ready() const noexcept { return handle_.promise().completed(); }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    // Set caller, and run a callee which has not started yet right here instead of a hop through the scheduler. The
+    // spawn function of caller is propagated to callee. A callee which was started before keeps its spawn function.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    if (!promise.started()) {
+      promise.start_inline(h.promise().get_spawn());
+    }
+    // Returning false continues the caller right now: the callee has completed synchronously (or meanwhile on another
+    // thread). Otherwise the callee will spawn the caller in final_suspend.
+    return !promise.arrive_caller();
+  }
+
+  // Rethrows the exception of callee, so neither is noexcept
+  T& await_resume() { return value(); }
+
+  bool done() noexcept { return handle_.promise().completed(); }
+
+  T& value() {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+};
+
+//
+// SPSC queue
+//
+
+template <typename T, size_t CAPACITY>
+class spsc_queue {
+ public:
+  static_assert((CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of 2");
+
+  // Producer only
+  bool try_push(const T& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == CAPACITY) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == CAPACITY) {
+        return false;
+      }
+    }
+    slots_[tail & (CAPACITY - 1)] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only
+  bool try_pop(T& value) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) {
+        return false;
+      }
+    }
+    value = slots_[head & (CAPACITY - 1)];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire); }
+
+ private:
+  // The consumer side and producer side are on their own cache lines
+  alignas(64) std::atomic<size_t> head_ = 0;
+  size_t tail_cache_ = 0;
+  alignas(64) std::atomic<size_t> tail_ = 0;
+  size_t head_cache_ = 0;
+  alignas(64) std::array<T, CAPACITY> slots_;
+};
+
+//
+// Sharded runtime
+//
+
+// A function to run on the target shard
+struct message {
+  void (*run)(void*);
+  void* arg;
+};
+
+// The spawn function of the runtime thread
+thread_local const spawn_function* current_spawn = nullptr;
+
+// A coroutine which runs at once and destroys itself, it's the root of the tasks on a runtime thread
+struct detached {
+  struct promise_type {
+    detached get_return_object() noexcept { return {}; }
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+
+    std::suspend_never final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() noexcept { std::terminate(); }
+
+    void return_void() noexcept {}
+
+    spawn_function get_spawn() { return *current_spawn; }
+
+    static void* operator new(size_t size) { return frame_pool::allocate(size); }
+
+    static void operator delete(void* ptr, size_t size) noexcept { frame_pool::deallocate(ptr, size); }
+  };
+};
+
+class sharded_runtime {
+ public:
+  static constexpr size_t queue_capacity = 1024;
+
+  class shard {
+   public:
+    shard(sharded_runtime& runtime, size_t id)
+        : runtime_(runtime), id_(id), backlogs_(runtime.size()), spawn_([this](std::coroutine_handle<> h) {
+            ready_.push_back(h);
+          }) {}
+
+    size_t id() const { return id_; }
+
+    spawn_function get_spawn() const { return spawn_; }
+
+    // Send a message from current shard to the target one
+    void post(size_t target, message m) {
+      auto& backlog = backlogs_[target];
+      if (!backlog.empty() || !runtime_.queue(id_, target).try_push(m)) {
+        backlog.push_back(m);
+        return;
+      }
+      runtime_.shards_[target]->wake();
+    }
+
+    // Send a message from a thread out of the runtime
+    void submit(message m) {
+      {
+        std::lock_guard lock(m_);
+        external_.push_back(m);
+        has_external_.store(true, std::memory_order_relaxed);
+      }
+      wake();
+    }
+
+    void add_timer(std::chrono::steady_clock::time_point deadline, std::coroutine_handle<> h) {
+      timers_.push({deadline, timer_sequence_++, h});
+    }
+
+   private:
+    friend sharded_runtime;
+
+    struct timer {
+      std::chrono::steady_clock::time_point deadline;
+      uint64_t sequence;
+      std::coroutine_handle<> handle;
+
+      bool operator>(const timer& other) const {
+        return deadline != other.deadline ? deadline > other.deadline : sequence > other.sequence;
+      }
+    };
+
+    void loop() {
+      current_spawn = &spawn_;
+      while (!runtime_.stopping_.load(std::memory_order_acquire)) {
+        size_t work = poll() + flush_backlogs() + run_timers();
+        // The coroutines which are ready now, the new ones wait for the next round after polling
+        for (size_t n = ready_.size(); n > 0; --n, ++work) {
+          auto h = ready_.front();
+          ready_.pop_front();
+          h.resume();
+        }
+        if (work == 0) {
+          idle();
+        }
+      }
+    }
+
+    size_t poll() {
+      size_t n = 0;
+      message m;
+      for (size_t source = 0; source < runtime_.size(); ++source) {
+        auto& queue = runtime_.queue(source, id_);
+        while (queue.try_pop(m)) {
+          m.run(m.arg);
+          ++n;
+        }
+      }
+      if (has_external_.load(std::memory_order_relaxed)) {
+        std::vector<message> messages;
+        {
+          std::lock_guard lock(m_);
+          messages.swap(external_);
+          has_external_.store(false, std::memory_order_relaxed);
+        }
+        for (auto& m : messages) {
+          m.run(m.arg);
+          ++n;
+        }
+      }
+      return n;
+    }
+
+    size_t flush_backlogs() {
+      size_t n = 0;
+      for (size_t target = 0; target < backlogs_.size(); ++target) {
+        auto& backlog = backlogs_[target];
+        auto& queue = runtime_.queue(id_, target);
+        size_t sent = 0;
+        while (!backlog.empty() && queue.try_push(backlog.front())) {
+          backlog.pop_front();
+          ++sent;
+        }
+        if (sent > 0) {
+          runtime_.shards_[target]->wake();
+        }
+        n += sent;
+      }
+      return n;
+    }
+
+    size_t run_timers() {
+      size_t n = 0;
+      auto now = std::chrono::steady_clock::now();
+      while (!timers_.empty() && timers_.top().deadline <= now) {
+        ready_.push_back(timers_.top().handle);
+        timers_.pop();
+        ++n;
+      }
+      return n;
+    }
+
+    bool has_messages() const {
+      for (size_t source = 0; source < runtime_.size(); ++source) {
+        if (!runtime_.queue(source, id_).empty()) {
+          return true;
+        }
+      }
+      return has_external_.load(std::memory_order_relaxed) || runtime_.stopping_.load(std::memory_order_acquire);
+    }
+
+    bool has_backlog() const {
+      for (auto& backlog : backlogs_) {
+        if (!backlog.empty()) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Sleep until a message or the next timer
+    void idle() {
+      if (has_backlog()) {
+        // The receiver is busy, retry later
+        std::this_thread::yield();
+        return;
+      }
+      sleeping_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      {
+        std::unique_lock lock(m_);
+        if (!has_messages()) {
+          if (timers_.empty()) {
+            cv_.wait(lock);
+          } else {
+            cv_.wait_until(lock, timers_.top().deadline);
+          }
+        }
+      }
+      sleeping_.store(false, std::memory_order_relaxed);
+    }
+
+    // Called by the sender after the message is pushed
+    void wake() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sleeping_.load(std::memory_order_relaxed)) {
+        std::lock_guard lock(m_);
+        cv_.notify_one();
+      }
+    }
+
+    sharded_runtime& runtime_;
+    size_t id_;
+    // Owned by the thread of this shard
+    std::deque<std::coroutine_handle<>> ready_;
+    std::priority_queue<timer, std::vector<timer>, std::greater<>> timers_;
+    uint64_t timer_sequence_ = 0;
+    std::vector<std::deque<message>> backlogs_;
+    spawn_function spawn_;
+    // Shared with the senders
+    std::atomic<bool> sleeping_ = false;
+    std::atomic<bool> has_external_ = false;
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::vector<message> external_;
+  };
+
+  explicit sharded_runtime(size_t num_shards) : num_shards_(num_shards), queues_(num_shards * num_shards) {
+    for (auto& queue : queues_) {
+      queue = std::make_unique<spsc_queue<message, queue_capacity>>();
+    }
+    for (size_t i = 0; i < num_shards; ++i) {
+      shards_.push_back(std::make_unique<shard>(*this, i));
+    }
+    size_t num_cores = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < num_shards; ++i) {
+      threads_.emplace_back([this, i] {
+        current_ = shards_[i].get();
+        current_->loop();
+      });
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(i % num_cores, &cpus);
+      // Pinning is best-effort: it fails when the core is not in the cpuset of the process (e.g. in a container), and
+      // then the shard just runs unpinned, which only costs the locality
+      (void)pthread_setaffinity_np(threads_.back().native_handle(), sizeof(cpus), &cpus);
+    }
+  }
+
+  ~sharded_runtime() {
+    stopping_.store(true, std::memory_order_release);
+    for (auto& s : shards_) {
+      s->wake();
+    }
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  size_t size() const { return num_shards_; }
+
+  // The shard of current thread
+  static shard& current() { return *current_; }
+
+  // Run a task on a shard, and wait for it on current thread (which is not a shard)
+  template <typename T>
+  T run(size_t index, awaitable<T> task) {
+    struct context {
+      awaitable<T>& task;
+      std::optional<T> value;
+      std::exception_ptr exception;
+      std::binary_semaphore done{0};
+    } ctx{task, std::nullopt, nullptr};
+    shards_[index]->submit({[](void* arg) { root(static_cast<context*>(arg)); }, &ctx});
+    ctx.done.acquire();
+    if (ctx.exception) {
+      std::rethrow_exception(ctx.exception);
+    }
+    return std::move(*ctx.value);
+  }
+
+ private:
+  template <typename Context>
+  static detached root(Context* ctx) {
+    try {
+      ctx->value.emplace(co_await ctx->task);
+    } catch (...) {
+      ctx->exception = std::current_exception();
+    }
+    ctx->done.release();
+  }
+
+  spsc_queue<message, queue_capacity>& queue(size_t source, size_t target) const {
+    return *queues_[source * num_shards_ + target];
+  }
+
+  static thread_local shard* current_;
+
+  size_t num_shards_;
+  std::atomic<bool> stopping_ = false;
+  // The queue of (source, target) is at source * num_shards + target
+  std::vector<std::unique_ptr<spsc_queue<message, queue_capacity>>> queues_;
+  std::vector<std::unique_ptr<shard>> shards_;
+  std::vector<std::thread> threads_;
+};
+
+thread_local sharded_runtime::shard* sharded_runtime::current_ = nullptr;
+
+//
+// on_shard
+//
+
+template <typename T>
+struct is_awaitable : std::false_type {};
+
+template <typename T>
+struct is_awaitable<awaitable<T>> : std::true_type {};
+
+// The result of co_await, or the type itself
+template <typename T>
+struct awaited_type {
+  using type = T;
+};
+
+template <typename T>
+struct awaited_type<awaitable<T>> {
+  using type = T;
+};
+
+template <typename F>
+class on_shard_awaiter {
+ public:
+  using result_type = std::invoke_result_t<F&>;
+  using value_type = typename awaited_type<result_type>::type;
+
+  on_shard_awaiter(size_t target, F fn) : target_(target), fn_(std::move(fn)) {}
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    caller_ = h;
+    source_ = sharded_runtime::current().id();
+    sharded_runtime::current().post(target_, {&execute, this});
+  }
+
+  value_type await_resume() {
+    if (exception_) {
+      std::rethrow_exception(exception_);
+    }
+    return std::move(*value_);
+  }
+
+ private:
+  // On the target shard
+  static void execute(void* arg) {
+    auto self = static_cast<on_shard_awaiter*>(arg);
+    if constexpr (is_awaitable<result_type>::value) {
+      run_task(self);
+    } else {
+      try {
+        self->value_.emplace(self->fn_());
+      } catch (...) {
+        self->exception_ = std::current_exception();
+      }
+      reply(self);
+    }
+  }
+
+  static detached run_task(on_shard_awaiter* self) {
+    try {
+      self->value_.emplace(co_await self->fn_());
+    } catch (...) {
+      self->exception_ = std::current_exception();
+    }
+    reply(self);
+  }
+
+  // The awaiter must not be touched after this, the caller may be resumed at once
+  static void reply(on_shard_awaiter* self) {
+    sharded_runtime::current().post(self->source_, {&resume, self});
+  }
+
+  // On the source shard
+  static void resume(void* arg) { static_cast<on_shard_awaiter*>(arg)->caller_.resume(); }
+
+  size_t target_;
+  size_t source_ = 0;
+  F fn_;
+  std::coroutine_handle<> caller_;
+  std::optional<value_type> value_;
+  std::exception_ptr exception_;
+};
+
+// Run fn on shard n, fn may return a value or an awaitable
+template <typename F>
+on_shard_awaiter<F> on_shard(size_t n, F fn) {
+  return on_shard_awaiter<F>(n, std::move(fn));
+}
+
+// Sleep on the timers of current shard
+struct sleep_for {
+  std::chrono::steady_clock::duration duration;
+
+  constexpr bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> h) {
+    sharded_runtime::current().add_timer(std::chrono::steady_clock::now() + duration, h);
+  }
+
+  void await_resume() noexcept {}
+};
+
+//
+// A single shared queue, served by a number of threads
+//
+
+class shared_queue_runtime {
+ public:
+  explicit shared_queue_runtime(size_t num_threads) {
+    for (size_t i = 0; i < num_threads; ++i) {
+      threads_.emplace_back([this] { loop(); });
+    }
+  }
+
+  ~shared_queue_runtime() {
+    {
+      std::lock_guard lock(m_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& t : threads_) {
+      t.join();
+    }
+  }
+
+  // Run a task, and wait for it on current thread (which is not a worker)
+  template <typename T>
+  T run(awaitable<T> task) {
+    struct context {
+      awaitable<T>& task;
+      std::optional<T> value;
+      std::exception_ptr exception;
+      std::binary_semaphore done{0};
+    } ctx{task, std::nullopt, nullptr};
+    root(this, &ctx);
+    ctx.done.acquire();
+    if (ctx.exception) {
+      std::rethrow_exception(ctx.exception);
+    }
+    return std::move(*ctx.value);
+  }
+
+ private:
+  // Move current coroutine to a worker
+  struct schedule {
+    shared_queue_runtime& runtime;
+
+    constexpr bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) { runtime.spawn_(h); }
+
+    void await_resume() noexcept {}
+  };
+
+  template <typename Context>
+  static detached root(shared_queue_runtime* runtime, Context* ctx) {
+    co_await schedule{*runtime};
+    try {
+      ctx->value.emplace(co_await ctx->task);
+    } catch (...) {
+      ctx->exception = std::current_exception();
+    }
+    ctx->done.release();
+  }
+
+  void loop() {
+    current_spawn = &spawn_;
+    while (true) {
+      std::coroutine_handle<> h;
+      {
+        std::unique_lock lock(m_);
+        cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+        if (stopping_) {
+          return;
+        }
+        h = queue_.front();
+        queue_.pop_front();
+      }
+      h.resume();
+    }
+  }
+
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::deque<std::coroutine_handle<>> queue_;
+  bool stopping_ = false;
+  spawn_function spawn_ = [this](std::coroutine_handle<> h) {
+    {
+      std::lock_guard lock(m_);
+      queue_.push_back(h);
+    }
+    cv_.notify_one();
+  };
+  std::vector<std::thread> threads_;
+};
+
+// Suspend and get scheduled again
+struct reschedule {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    h.promise().get_spawn()(h);
+  }
+
+  void await_resume() noexcept {}
+};
+
+// The spawn function of current coroutine
+struct this_spawn {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    spawn_ = h.promise().get_spawn();
+    return false;
+  }
+
+  spawn_function await_resume() noexcept { return std::move(spawn_); }
+
+  spawn_function spawn_;
+};
+
+//
+// Test
+//
+
+constexpr size_t num_shards = 4;
+constexpr uint64_t num_keys = 1 << 16;
+constexpr size_t clients_per_shard = 64;
+constexpr size_t ops_per_client = 2000;
+
+// A 90% get and 10% put request
+struct request {
+  uint64_t key;
+  bool put;
+};
+
+uint64_t apply(std::unordered_map<uint64_t, uint64_t>& map, request r) {
+  if (r.put) {
+    map[r.key] = r.key;
+    return 0;
+  }
+  return map.count(r.key);
+}
+
+request next_request(std::mt19937_64& rng) { return {rng() % num_keys, rng() % 10 == 0}; }
+
+// Sharded: each shard owns the keys of key % num_shards
+struct sharded_kv {
+  std::vector<std::unordered_map<uint64_t, uint64_t>> maps{num_shards};
+};
+
+awaitable<uint64_t> sharded_client(sharded_kv& kv, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  uint64_t found = 0;
+  for (size_t i = 0; i < ops_per_client; ++i) {
+    auto r = next_request(rng);
+    size_t owner = r.key % num_shards;
+    if (owner == sharded_runtime::current().id()) {
+      found += apply(kv.maps[owner], r);
+    } else {
+      found += co_await on_shard(owner, [&kv, owner, r] { return apply(kv.maps[owner], r); });
+    }
+  }
+  co_return found;
+}
+
+// Start the clients at once and wait for all of them
+template <typename F>
+awaitable<uint64_t> all_clients(size_t num, F make_client) {
+  auto spawn = co_await this_spawn{};
+  std::vector<awaitable<uint64_t>> clients;
+  clients.reserve(num);
+  for (size_t i = 0; i < num; ++i) {
+    clients.push_back(make_client(i));
+    clients.back().set_spawn(spawn);
+  }
+  uint64_t total = 0;
+  for (auto& c : clients) {
+    total += co_await c;
+  }
+  co_return total;
+}
+
+awaitable<uint64_t> sharded_benchmark(sharded_kv& kv) {
+  return all_clients(num_shards, [&kv](size_t shard) {
+    return [](sharded_kv& kv, size_t shard) -> awaitable<uint64_t> {
+      co_return co_await on_shard(shard, [&kv, shard] {
+        return all_clients(clients_per_shard,
+                           [&kv, shard](size_t i) { return sharded_client(kv, shard * clients_per_shard + i); });
+      });
+    }(kv, shard);
+  });
+}
+
+// Shared: one map behind a lock, and every request is a hop through the shared queue
+struct shared_kv {
+  std::mutex m;
+  std::unordered_map<uint64_t, uint64_t> map;
+};
+
+awaitable<uint64_t> shared_client(shared_kv& kv, uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  uint64_t found = 0;
+  for (size_t i = 0; i < ops_per_client; ++i) {
+    auto r = next_request(rng);
+    co_await reschedule{};
+    std::lock_guard lock(kv.m);
+    found += apply(kv.map, r);
+  }
+  co_return found;
+}
+
+awaitable<int> hello() {
+  size_t home = sharded_runtime::current().id();
+  auto remote = co_await on_shard(2, [] { return sharded_runtime::current().id(); });
+  auto doubled = co_await on_shard(3, []() -> awaitable<int> {
+    co_await sleep_for(1ms);
+    co_return int(sharded_runtime::current().id()) * 2;
+  });
+  std::cout << "home shard:" << home << " on_shard(2) ran on:" << remote << " on_shard(3) returned:" << doubled
+            << " resumed on:" << sharded_runtime::current().id() << std::endl;
+  co_return doubled;
+}
+
+awaitable<int> failing() {
+  throw std::runtime_error("the task failed");
+  co_return 0;
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  {
+    sharded_runtime runtime(num_shards);
+    runtime.run(1, hello());
+    try {
+      runtime.run(2, failing());
+    } catch (const std::runtime_error& e) {
+      std::cout << "sharded runtime rethrows: " << e.what() << std::endl;
+    }
+  }
+  {
+    shared_queue_runtime runtime(num_shards);
+    try {
+      runtime.run(failing());
+    } catch (const std::runtime_error& e) {
+      std::cout << "shared queue runtime rethrows: " << e.what() << std::endl;
+    }
+  }
+  //
+  // Benchmark: a key-value store, 4 threads, 256 clients, 90% get
+  //
+  sharded_kv skv;
+  shared_kv qkv;
+  for (uint64_t key = 0; key < num_keys; ++key) {
+    skv.maps[key % num_shards][key] = key;
+    qkv.map[key] = key;
+  }
+  constexpr size_t num_ops = num_shards * clients_per_shard * ops_per_client;
+  uint64_t found1 = 0, found2 = 0;
+  double sharded_s = 0, shared_s = 0;
+  {
+    sharded_runtime runtime(num_shards);
+    sharded_s = measure([&] { found1 = runtime.run(0, sharded_benchmark(skv)); });
+  }
+  {
+    shared_queue_runtime runtime(num_shards);
+    shared_s = measure([&] {
+      found2 = runtime.run(all_clients(num_shards * clients_per_shard,
+                                       [&qkv](size_t i) { return shared_client(qkv, i); }));
+    });
+  }
+  std::cout << "[+] Benchmark: " << num_ops << " requests, " << num_shards << " threads on "
+            << std::thread::hardware_concurrency() << " cores (Mops/s)" << std::endl;
+  std::cout << "sharded, on_shard: " << num_ops / sharded_s / 1e6 << std::endl;
+  std::cout << "shared queue, locked map: " << num_ops / shared_s / 1e6 << std::endl;
+  bool ok = found1 == found2;
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+home shard:1 on_shard(2) ran on:2 on_shard(3) returned:6 resumed on:1
+sharded runtime rethrows: the task failed
+shared queue runtime rethrows: the task failed
+[+] Benchmark: 512000 requests, 4 threads on 1 cores (Mops/s)
+sharded, on_shard: 2.24
+shared queue, locked map: 3.74
+OK
+
+NOTE: It's measured on a single core machine, where the 4 threads never run at the same time: the lock and the shared
+queue have no contention, and a remote request of the sharded runtime (3/4 of them) costs two messages, and usually a
+context switch to the shard which owns the key. The sharded runtime is for the other case, one thread per real core,
+where the shared queue and the lock are contended by all of them and the shards share nothing.
+*/
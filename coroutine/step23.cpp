@@ -0,0 +1,519 @@
+/* Author: lipixun
+ * Created Time : 2026-10-21 09:40:18
+ *
+ * File Name: step23.cpp
+ * Description:
+ *
+ *  Step 23: Cooperative preemption
+ *  - A coroutine runs until it suspends. With the synchronous completion of step 20, a long computation made of many
+ *    small awaitables never goes back to the scheduler, and every other handle in the queue waits for it.
+ *  - `co_await yield_now()` puts the current task behind the others in the queue.
+ *  - The scheduler gives each resumed task a budget, in operations (co_awaits of awaitable) or in time. It's charged
+ *    in await_ready, and when it's used up, the awaitable suspends even if the callee has completed: the caller or
+ *    the callee is spawned to the end of the queue, so the task yields without any change in its code. A scheduler
+ *    started inside a task restores the limits of the outer one when it returns.
+ *  - The benchmark measures the latency of short tasks arriving every 200us while 4 CPU bound tasks run.
+ *  - The awaitable is the one of step 20.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <concepts>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <semaphore>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+using spawn_function = std::function<void(std::coroutine_handle<>)>;
+
+//
+// Resume budget
+//
+
+namespace resume_budget {
+
+// Zero means unlimited
+struct limits {
+  size_t operations = 0;
+  std::chrono::nanoseconds time{0};
+};
+
+// The limits of the scheduler of current thread, and the slice of the task it resumed
+thread_local limits current_limits;
+thread_local size_t operations = 0;
+thread_local std::chrono::steady_clock::time_point slice_start;
+
+// Called by the scheduler before resuming a task
+void begin_slice() {
+  operations = 0;
+  if (current_limits.time.count() > 0) {
+    slice_start = std::chrono::steady_clock::now();
+  }
+}
+
+// Charge an operation, true when the budget is used up
+bool charge() {
+  ++operations;
+  if (current_limits.operations > 0 && operations > current_limits.operations) {
+    return true;
+  }
+  return current_limits.time.count() > 0 && std::chrono::steady_clock::now() - slice_start > current_limits.time;
+}
+
+// Set the limits of a scheduler on current thread. The ones of the outer scheduler (when the scheduler runs inside a
+// task of another one) and its slice are restored on destruction.
+class scoped_limits {
+ public:
+  explicit scoped_limits(limits l) noexcept
+      : outer_limits_(std::exchange(current_limits, l)),
+        outer_operations_(operations),
+        outer_slice_start_(slice_start) {}
+
+  scoped_limits(const scoped_limits&) = delete;
+
+  ~scoped_limits() {
+    current_limits = outer_limits_;
+    operations = outer_operations_;
+    slice_start = outer_slice_start_;
+  }
+
+ private:
+  limits outer_limits_;
+  size_t outer_operations_;
+  std::chrono::steady_clock::time_point outer_slice_start_;
+};
+
+}  // namespace resume_budget
+
+//
+// The awaitable of step 20, with the resume budget
+//
+
+template <typename T>
+class awaitable {
+ public:
+  //
+  // Promise type
+  //
+
+  class promise_type {
+   public:
+    awaitable get_return_object() {
+      // Create a new awaitable object. It's awaitable's responsible to destroy handle
+      return awaitable(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Spawn the caller when current coroutine has suspended, since the caller may destroy the frame at once on
+    // another thread
+    struct final_awaiter {
+      constexpr bool await_ready() const noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        auto& promise = h.promise();
+        // The caller is only resumed by us when it has suspended, otherwise it's still in await_suspend and continues
+        if (promise.arrive_final() && promise.spawn_ && promise.caller_handle_) {
+          // The callee is completed, and we should schedule the await_resume of caller. Nothing of the frame is
+          // touched after that.
+          auto spawn = promise.spawn_;
+          spawn(promise.caller_handle_);
+        }
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    final_awaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() {
+      // Store exception
+      exception_ = std::current_exception();
+    }
+
+    template <std::convertible_to<T> U>
+    void return_value(U&& value) {
+      // Store return value
+      value_ = std::forward<U>(value);
+    }
+
+    // Run the coroutine from initial_suspend on the current thread, until it completes or suspends
+    void start_inline(spawn_function f) {
+      spawn_ = std::move(f);
+      init_spawned_ = true;
+      std::coroutine_handle<promise_type>::from_promise(*this).resume();
+    }
+
+    bool started() const noexcept { return init_spawned_; }
+
+    // The caller (after setting itself) and final_suspend both arrive, the second one resumes the caller. Each returns
+    // whether the other one has arrived.
+    bool arrive_caller() noexcept {
+      return arrived_.fetch_or(caller_arrived, std::memory_order_acq_rel) & final_arrived;
+    }
+
+    bool arrive_final() noexcept {
+      return arrived_.fetch_or(final_arrived, std::memory_order_acq_rel) & caller_arrived;
+    }
+
+    // Whether final_suspend has arrived, the result is visible then. handle_.done() can't tell it on another thread,
+    // it's not synchronized with the thread running the callee.
+    bool completed() const noexcept { return arrived_.load(std::memory_order_acquire) & final_arrived; }
+
+    void set_caller(std::coroutine_handle<> handle) {
+      // Store the caller of current coroutine.
+      // This function may be called multiple times (one time per co_await from caller)
+      caller_handle_ = handle;
+    }
+
+    //
+    // Get & set spawn function. The handle only by ran when spawn function is set.
+    // The spawn function may be changed at any time current coroutine is suspended.
+    // That means the current coroutine or the caller's coroutine may resume at different thread.
+    //
+    spawn_function get_spawn() { return spawn_; }
+
+    void set_spawn(spawn_function f) {
+      spawn_ = f;
+      if (f && !init_spawned_) {
+        init_spawned_ = true;
+        // Schedule current coroutine to continue from initial_suspend
+        f(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    }
+
+   private:
+    friend awaitable;
+
+    // Whether the caller or final_suspend has arrived
+    static constexpr uint8_t caller_arrived = 1;
+    static constexpr uint8_t final_arrived = 2;
+    std::atomic<uint8_t> arrived_ = 0;
+    // Check if current coroutine has been resumed after initial suspend.
+    bool init_spawned_ = false;
+    // The spawn function
+    spawn_function spawn_;
+    // Store the return value & exception
+    std::optional<T> value_;
+    std::exception_ptr exception_;
+    // The caller coroutine handle
+    std::coroutine_handle<> caller_handle_;
+  };
+
+  //
+  // Awaitable
+  //
+
+  ~awaitable() noexcept {
+    // Destroy the handle
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  awaitable(const awaitable&) = delete;  // Cannot copy awaitable
+
+  awaitable(awaitable&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+    // NOTE: This is tricky. A moved awaitable is not available any more but I didn't handle the case.
+  }
+
+  // A completed callee is just a result read, unless the budget of current task is used up
+  bool await_ready() noexcept {
+    yield_ = resume_budget::charge();
+    return handle_.promise().completed() && !yield_;
+  }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    // Set caller, and run a callee which has not started yet right here instead of a hop through the scheduler. The
+    // spawn function of caller is propagated to callee. A callee which was started before keeps its spawn function.
+    // NOTE:
+    //  [handle_] is the [callee]'s coroutine_handle
+    //  [h] is the [caller]'s coroutin_handle
+    auto& promise = handle_.promise();
+    promise.set_caller(h);
+    if (yield_) {
+      // Out of budget, go behind the others in the queue: the callee is started by the scheduler as step 10, or the
+      // caller is spawned again when the callee has completed.
+      if (!promise.started()) {
+        promise.arrive_caller();
+        promise.set_spawn(h.promise().get_spawn());
+        return true;
+      }
+      if (promise.completed()) {
+        h.promise().get_spawn()(h);
+        return true;
+      }
+    } else if (!promise.started()) {
+      promise.start_inline(h.promise().get_spawn());
+    }
+    // Returning false continues the caller right now: the callee has completed synchronously (or meanwhile on another
+    // thread). Otherwise the callee will spawn the caller in final_suspend.
+    return !promise.arrive_caller();
+  }
+
+  T& await_resume() noexcept { return value(); }
+
+  bool done() noexcept { return handle_.promise().completed(); }
+
+  T& value() noexcept {
+    auto& promise = handle_.promise();
+    if (promise.exception_) {
+      std::rethrow_exception(promise.exception_);
+    }
+    return *promise.value_;
+  }
+
+  spawn_function get_spawn() { return handle_.promise().get_spawn(); }
+
+  void set_spawn(spawn_function f) { return handle_.promise().set_spawn(f); }
+
+ private:
+  friend promise_type;
+
+  explicit awaitable(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+  // The callee corouting handle
+  std::coroutine_handle<promise_type> handle_;
+  // Set by await_ready when the caller must yield
+  bool yield_ = false;
+};
+
+// Put current task behind the others
+struct yield_now {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  void await_suspend(std::coroutine_handle<Promise> h) {
+    h.promise().get_spawn()(h);
+  }
+
+  void await_resume() noexcept {}
+};
+
+// The spawn function of current coroutine
+struct this_spawn {
+  constexpr bool await_ready() const noexcept { return false; }
+
+  template <typename Promise>
+  bool await_suspend(std::coroutine_handle<Promise> h) {
+    spawn_ = h.promise().get_spawn();
+    return false;
+  }
+
+  spawn_function await_resume() noexcept { return std::move(spawn_); }
+
+  spawn_function spawn_;
+};
+
+//
+// The simple scheduler of step 10, with a resume budget
+//
+
+template <typename T>
+T spawn(awaitable<T>&& task, resume_budget::limits limits = {}) {
+  std::mutex m;
+  std::counting_semaphore queue_size{0};
+  std::queue<std::coroutine_handle<>> h_queue;
+  spawn_function spawn = [&m, &queue_size, &h_queue](std::coroutine_handle<> h) {
+    {
+      std::lock_guard lock(m);
+      h_queue.emplace(h);
+    }
+    queue_size.release();
+  };
+
+  resume_budget::scoped_limits scoped(limits);
+  task.set_spawn(spawn);
+
+  while (!task.done()) {
+    queue_size.acquire();
+    std::coroutine_handle<> handle;
+    {
+      std::lock_guard lock(m);
+      handle = h_queue.front();
+      h_queue.pop();
+    }
+    resume_budget::begin_slice();
+    handle();
+  }
+
+  return task.value();
+}
+
+//
+// Test
+//
+
+using clock_type = std::chrono::steady_clock;
+
+// About 1us of work
+awaitable<uint64_t> crunch(uint64_t seed) {
+  uint64_t x = seed | 1;
+  for (int i = 0; i < 400; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  co_return x;
+}
+
+// CPU bound, yields every yield_every blocks when it's not 0
+awaitable<uint64_t> long_task(size_t blocks, size_t yield_every) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < blocks; ++i) {
+    sum += co_await crunch(i);
+    if (yield_every > 0 && (i + 1) % yield_every == 0) {
+      co_await yield_now();
+    }
+  }
+  co_return sum;
+}
+
+awaitable<uint64_t> short_task(clock_type::time_point arrival, std::vector<double>& latencies) {
+  auto value = co_await crunch(arrival.time_since_epoch().count());
+  latencies.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - arrival).count());
+  co_return value;
+}
+
+// Start a short task every interval, the latency counts from the time it should arrive
+awaitable<uint64_t> arrivals(size_t num, clock_type::duration interval, std::vector<double>& latencies) {
+  auto spawn = co_await this_spawn{};
+  std::vector<awaitable<uint64_t>> tasks;
+  tasks.reserve(num);
+  auto arrival = clock_type::now();
+  for (size_t i = 0; i < num; ++i, arrival += interval) {
+    while (clock_type::now() < arrival) {
+      co_await yield_now();
+    }
+    tasks.push_back(short_task(arrival, latencies));
+    tasks.back().set_spawn(spawn);
+  }
+  uint64_t sum = 0;
+  for (auto& t : tasks) {
+    sum += co_await t;
+  }
+  co_return sum;
+}
+
+struct mix_result {
+  uint64_t long_sum = 0;
+  double long_ms = 0;
+};
+
+awaitable<mix_result> mix(size_t yield_every, std::vector<double>& latencies) {
+  constexpr size_t num_long = 4;
+  constexpr size_t blocks = 25000;
+  auto spawn = co_await this_spawn{};
+  auto start = clock_type::now();
+  std::vector<awaitable<uint64_t>> tasks;
+  tasks.reserve(num_long + 1);
+  tasks.push_back(arrivals(500, 200us, latencies));
+  tasks.back().set_spawn(spawn);
+  for (size_t i = 0; i < num_long; ++i) {
+    tasks.push_back(long_task(blocks, yield_every));
+    tasks.back().set_spawn(spawn);
+  }
+  mix_result result;
+  for (auto& t : std::span(tasks).subspan(1)) {
+    result.long_sum += co_await t;
+  }
+  result.long_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+  auto& arrivals_task = tasks.front();
+  co_await arrivals_task;
+  co_return result;
+}
+
+double percentile(std::vector<double> values, double p) {
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  {
+    std::vector<std::string> trace;
+    auto worker = [](std::string name, std::vector<std::string>& trace) -> awaitable<int> {
+      for (int i = 0; i < 3; ++i) {
+        trace.push_back(name + std::to_string(i));
+        co_await crunch(i);
+      }
+      co_return 0;
+    };
+    auto both = [&]() -> awaitable<int> {
+      auto spawn = co_await this_spawn{};
+      auto a = worker("a", trace);
+      auto b = worker("b", trace);
+      a.set_spawn(spawn);
+      b.set_spawn(spawn);
+      co_await a;
+      co_await b;
+      co_return 0;
+    };
+    for (size_t budget : {0, 1}) {
+      trace.clear();
+      spawn(both(), {.operations = budget});
+      if (budget == 0) {
+        std::cout << "unlimited budget:";
+      } else {
+        std::cout << "budget of " << budget << " operations:";
+      }
+      for (auto& t : trace) {
+        std::cout << " " << t;
+      }
+      std::cout << std::endl;
+    }
+  }
+  //
+  // Benchmark: 500 short tasks, one per 200us, along with 4 CPU bound tasks of 25000 blocks
+  //
+  struct mode {
+    const char* name;
+    size_t yield_every;
+    resume_budget::limits limits;
+  };
+  std::cout << "[+] Benchmark: latency of short tasks along with CPU bound tasks" << std::endl;
+  uint64_t expected = 0;
+  bool ok = true;
+  for (auto [name, yield_every, limits] : {mode{"no yield", 0, {}}, mode{"yield_now every 100 blocks", 100, {}},
+                                           mode{"budget of 100 operations", 0, {.operations = 100}},
+                                           mode{"budget of 100us", 0, {.time = 100us}}}) {
+    std::vector<double> latencies;
+    auto result = spawn(mix(yield_every, latencies), limits);
+    expected = expected ? expected : result.long_sum;
+    ok = ok && result.long_sum == expected && latencies.size() == 500;
+    std::cout << name << ": p50 " << percentile(latencies, 0.5) << "us, p99 " << percentile(latencies, 0.99)
+              << "us, max " << percentile(latencies, 1) << "us, long tasks " << result.long_ms << "ms" << std::endl;
+  }
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+unlimited budget: a0 a1 a2 b0 b1 b2
+budget of 1 operations: a0 a1 b0 b1 a2 b2
+[+] Benchmark: latency of short tasks along with CPU bound tasks
+no yield: p50 57183.5us, p99 105931us, max 106531us, long tasks 106.7ms
+yield_now every 100 blocks: p50 618.2us, p99 861.5us, max 1006.3us, long tasks 103.9ms
+budget of 100 operations: p50 217.4us, p99 455.6us, max 609.6us, long tasks 104.5ms
+budget of 100us: p50 216.5us, p99 415.4us, max 715.0us, long tasks 114.0ms
+OK
+*/
@@ -0,0 +1,300 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 15:10:52
+ *
+ * File Name: cpu_dispatch.cpp
+ * Description:
+ *
+ *  Runtime dispatch by CPU features, built on optional_type2.
+ *
+ *  The selector has a second axis: the ISA level. Kernels are registered by specializing
+ *  algorithm_implementation_traits<T, ISA>, a missing specialization falls back to the next lower level and finally to
+ *  the default implementation. The CPU is detected once by cpuid, and the function pointer is resolved once at
+ *  startup (like an ifunc resolver), so there's no branching per call.
+ *
+ */
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+//
+// CPU detection
+//
+
+enum class isa_level : int { scalar = 0, sse42 = 1, avx2 = 2, avx512 = 3 };
+
+const char* isa_level_name(isa_level level) {
+  static const char* names[] = {"scalar", "sse4.2", "avx2", "avx512"};
+  return names[static_cast<int>(level)];
+}
+
+isa_level detect_isa_level() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_2)) {
+    return isa_level::scalar;
+  }
+  // AVX registers must be enabled by the OS as well (XCR0)
+  if (!(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+    return isa_level::sse42;
+  }
+  unsigned int xcr0_lo, xcr0_hi;
+  asm("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+  if ((xcr0_lo & 0x6) != 0x6 || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) || !(ebx & bit_AVX2)) {
+    return isa_level::sse42;
+  }
+  if ((xcr0_lo & 0xe6) != 0xe6 || !(ebx & bit_AVX512F)) {
+    return isa_level::avx2;
+  }
+  return isa_level::avx512;
+}
+
+// Detected once
+isa_level cpu_isa_level() {
+  static const isa_level level = detect_isa_level();
+  return level;
+}
+
+//
+// The default implementation
+//
+
+template <typename T>
+struct algorithm_implementation {
+  struct implementation {
+    static constexpr const char* name = "default";
+
+    static T run(const T* data, size_t size) {
+      T sum = 0;
+      for (size_t i = 0; i < size; ++i) {
+        sum += data[i];
+      }
+      return sum;
+    }
+  };
+};
+
+//
+// The specialized implementations, by type and ISA level
+//
+
+template <typename T, isa_level ISA>
+struct algorithm_implementation_traits {
+  algorithm_implementation_traits() = delete;
+};
+
+template <typename T, isa_level ISA>
+concept is_algorithm_implementation_specialized = requires { algorithm_implementation_traits<T, ISA>(); };
+
+template <>
+struct algorithm_implementation_traits<int, isa_level::sse42> {
+  struct implementation {
+    static constexpr const char* name = "int sse4.2";
+
+    __attribute__((target("sse4.2"))) static int run(const int* data, size_t size) {
+      __m128i acc = _mm_setzero_si128();
+      size_t i = 0;
+      for (; i + 4 <= size; i += 4) {
+        acc = _mm_add_epi32(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+      }
+      acc = _mm_hadd_epi32(acc, acc);
+      acc = _mm_hadd_epi32(acc, acc);
+      int sum = _mm_cvtsi128_si32(acc);
+      for (; i < size; ++i) {
+        sum += data[i];
+      }
+      return sum;
+    }
+  };
+};
+
+template <>
+struct algorithm_implementation_traits<int, isa_level::avx2> {
+  struct implementation {
+    static constexpr const char* name = "int avx2";
+
+    __attribute__((target("avx2"))) static int run(const int* data, size_t size) {
+      __m256i acc = _mm256_setzero_si256();
+      size_t i = 0;
+      for (; i + 8 <= size; i += 8) {
+        acc = _mm256_add_epi32(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+      }
+      __m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+      half = _mm_hadd_epi32(half, half);
+      half = _mm_hadd_epi32(half, half);
+      int sum = _mm_cvtsi128_si32(half);
+      for (; i < size; ++i) {
+        sum += data[i];
+      }
+      return sum;
+    }
+  };
+};
+
+template <>
+struct algorithm_implementation_traits<int, isa_level::avx512> {
+  struct implementation {
+    static constexpr const char* name = "int avx512";
+
+    __attribute__((target("avx512f"))) static int run(const int* data, size_t size) {
+      __m512i acc = _mm512_setzero_si512();
+      size_t i = 0;
+      for (; i + 16 <= size; i += 16) {
+        acc = _mm512_add_epi32(acc, _mm512_loadu_si512(data + i));
+      }
+      // The tail is handled by a masked load
+      if (i < size) {
+        __mmask16 mask = static_cast<__mmask16>((1u << (size - i)) - 1);
+        acc = _mm512_add_epi32(acc, _mm512_maskz_loadu_epi32(mask, data + i));
+      }
+      // Reduced by halves as the avx2 one. The plain extracts (and _mm512_reduce_add_epi32) of gcc 12 start from an
+      // undefined vector, which -Wall reports as uninitialized, the zero masked ones don't.
+      __m256i acc256 = _mm256_add_epi32(_mm512_maskz_extracti64x4_epi64(0xFF, acc, 0),
+                                        _mm512_maskz_extracti64x4_epi64(0xFF, acc, 1));
+      __m128i acc128 = _mm_add_epi32(_mm256_castsi256_si128(acc256), _mm256_extracti128_si256(acc256, 1));
+      acc128 = _mm_hadd_epi32(acc128, acc128);
+      acc128 = _mm_hadd_epi32(acc128, acc128);
+      return _mm_cvtsi128_si32(acc128);
+    }
+  };
+};
+
+// Only an avx2 kernel for float. avx512 hosts fall back to it, sse4.2 hosts fall back to the default one.
+template <>
+struct algorithm_implementation_traits<float, isa_level::avx2> {
+  struct implementation {
+    static constexpr const char* name = "float avx2";
+
+    __attribute__((target("avx2"))) static float run(const float* data, size_t size) {
+      __m256 acc = _mm256_setzero_ps();
+      size_t i = 0;
+      for (; i + 8 <= size; i += 8) {
+        acc = _mm256_add_ps(acc, _mm256_loadu_ps(data + i));
+      }
+      __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+      half = _mm_hadd_ps(half, half);
+      half = _mm_hadd_ps(half, half);
+      float sum = _mm_cvtss_f32(half);
+      for (; i < size; ++i) {
+        sum += data[i];
+      }
+      return sum;
+    }
+  };
+};
+
+//
+// Compile time selector: the specialization of the ISA level, or the one of the next lower level.
+//
+
+template <typename T, isa_level ISA>
+struct algorithm_implementation_fallback {
+  static constexpr isa_level lower = static_cast<isa_level>(static_cast<int>(ISA) - 1);
+
+  using type =
+      std::conditional_t<is_algorithm_implementation_specialized<T, ISA>, algorithm_implementation_traits<T, ISA>,
+                         typename algorithm_implementation_fallback<T, lower>::type>;
+};
+
+template <typename T>
+struct algorithm_implementation_fallback<T, isa_level::scalar> {
+  using type = std::conditional_t<is_algorithm_implementation_specialized<T, isa_level::scalar>,
+                                  algorithm_implementation_traits<T, isa_level::scalar>, algorithm_implementation<T>>;
+};
+
+template <typename T, isa_level ISA>
+using algorithm_implementation_selector = typename algorithm_implementation_fallback<T, ISA>::type;
+
+//
+// Runtime selector: a table of the compile time selections, indexed by the detected ISA level.
+//
+
+template <typename T>
+struct algorithm_dispatcher {
+  using function = T (*)(const T*, size_t);
+
+  static constexpr function table[] = {
+      &algorithm_implementation_selector<T, isa_level::scalar>::implementation::run,
+      &algorithm_implementation_selector<T, isa_level::sse42>::implementation::run,
+      &algorithm_implementation_selector<T, isa_level::avx2>::implementation::run,
+      &algorithm_implementation_selector<T, isa_level::avx512>::implementation::run,
+  };
+
+  static constexpr const char* names[] = {
+      algorithm_implementation_selector<T, isa_level::scalar>::implementation::name,
+      algorithm_implementation_selector<T, isa_level::sse42>::implementation::name,
+      algorithm_implementation_selector<T, isa_level::avx2>::implementation::name,
+      algorithm_implementation_selector<T, isa_level::avx512>::implementation::name,
+  };
+
+  // Resolved once at startup
+  static inline const function run = table[static_cast<int>(cpu_isa_level())];
+};
+
+template <typename T>
+T run(const T* data, size_t size) {
+  // Just an indirect call, no branching by the CPU features
+  return algorithm_dispatcher<T>::run(data, size);
+}
+
+//
+// Test
+//
+
+template <typename T>
+void test(const char* type_name) {
+  std::vector<T> data(1000003);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<T>(i % 7);
+  }
+  auto expected = algorithm_implementation<T>::implementation::run(data.data(), data.size());
+  std::cout << "[+] " << type_name << std::endl;
+  for (int level = 0; level <= static_cast<int>(cpu_isa_level()); ++level) {
+    auto start = std::chrono::steady_clock::now();
+    T sum = 0;
+    for (int round = 0; round < 100; ++round) {
+      sum = algorithm_dispatcher<T>::table[level](data.data(), data.size());
+    }
+    auto us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / 100;
+    std::cout << isa_level_name(isa_level(level)) << " -> " << algorithm_dispatcher<T>::names[level] << ": " << us
+              << "us " << (sum == expected ? "OK" : "MISMATCH") << std::endl;
+  }
+  std::cout << "selected: " << algorithm_dispatcher<T>::names[static_cast<int>(cpu_isa_level())]
+            << " sum:" << run(data.data(), data.size()) << std::endl;
+}
+
+int main() {
+  std::cout << "cpu: " << isa_level_name(cpu_isa_level()) << std::endl;
+  test<int>("int");
+  test<float>("float");
+  test<double>("double");
+  return 0;
+}
+
+/*
+Outputs (-O2, on an avx512 host, the time varies by machine):
+cpu: avx512
+[+] int
+scalar -> default: 687.3us OK
+sse4.2 -> int sse4.2: 214.7us OK
+avx2 -> int avx2: 178.3us OK
+avx512 -> int avx512: 170.8us OK
+selected: int avx512 sum:3000003
+[+] float
+scalar -> default: 879.8us OK
+sse4.2 -> default: 845.5us OK
+avx2 -> float avx2: 180.1us OK
+avx512 -> float avx2: 179.6us OK
+selected: float avx2 sum:3e+06
+[+] double
+scalar -> default: 874.6us OK
+sse4.2 -> default: 857.7us OK
+avx2 -> default: 865.3us OK
+avx512 -> default: 868.3us OK
+selected: default sum:3e+06
+*/
@@ -0,0 +1,338 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 17:02:26
+ *
+ * File Name: dispatch_benchmark.cpp
+ * Description:
+ *
+ *  Measure template.cpp: the cost of dispatching a call over 1e6 heterogeneous objects with 2, 8 and 64 concrete
+ *  types, in sorted and shuffled order.
+ *
+ *    - virtual:  std::vector<BaseClass*>, each object is allocated separately
+ *    - crtp:     tagged records, the tag selects the CRTP type and the call is bound statically
+ *    - variant:  std::vector<std::variant<...>> + std::visit
+ *    - fnptr:    tagged records + a table of function pointers
+ *    - concept:  one std::vector per type, a concept-constrained template runs each of them. The order of the
+ *                objects is not kept, so sorted and shuffled are the same (the lower bound of the others).
+ *
+ *  The branch misses are read by perf_event_open, and reported as n/a when it's not permitted.
+ *
+ */
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+//
+// Branch miss counter
+//
+
+class branch_miss_counter {
+ public:
+  branch_miss_counter() {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+
+  branch_miss_counter(const branch_miss_counter&) = delete;
+
+  ~branch_miss_counter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  bool valid() const { return fd_ >= 0; }
+
+  void start() {
+    if (valid()) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  uint64_t stop() {
+    uint64_t count = 0;
+    if (valid()) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+        count = 0;
+      }
+    }
+    return count;
+  }
+
+ private:
+  int fd_;
+};
+
+//
+// The work of type I. It's different per type, and cheap enough to let the dispatch dominate.
+//
+
+template <size_t I>
+inline int compute(int value, int x) {
+  return (x * static_cast<int>(I + 3) + value) ^ static_cast<int>(I);
+}
+
+//
+// OOP
+//
+
+class BaseClass {
+ public:
+  virtual ~BaseClass() = default;
+  virtual int run(int x) const = 0;
+};
+
+template <size_t I>
+class SubClass : public BaseClass {
+ public:
+  explicit SubClass(int value) : value_(value) {}
+  int run(int x) const override { return compute<I>(value_, x); }
+
+ private:
+  int value_;
+};
+
+//
+// CRTP
+//
+
+template <typename Derived>
+struct CrtpBase {
+  int run(int x) const { return static_cast<const Derived*>(this)->run_impl(x); }
+};
+
+template <size_t I>
+struct CrtpClass : CrtpBase<CrtpClass<I>> {
+  int value;
+  int run_impl(int x) const { return compute<I>(value, x); }
+};
+
+// A record of any CRTP type, the tag tells which one
+struct Tagged {
+  uint32_t kind;
+  int value;
+};
+
+template <size_t... Is>
+inline int crtp_run(const Tagged& record, int x, std::index_sequence<Is...>) {
+  int result = 0;
+  ((record.kind == Is && (result = CrtpClass<Is>{{}, record.value}.run(x), true)) || ...);
+  return result;
+}
+
+//
+// Variant
+//
+
+template <size_t I>
+struct Plain {
+  int value;
+  int run(int x) const { return compute<I>(value, x); }
+};
+
+template <typename Seq>
+struct variant_of;
+
+template <size_t... Is>
+struct variant_of<std::index_sequence<Is...>> {
+  using type = std::variant<Plain<Is>...>;
+};
+
+//
+// Function pointer table
+//
+
+using run_function = int (*)(int, int);
+
+template <size_t... Is>
+constexpr std::array<run_function, sizeof...(Is)> make_table(std::index_sequence<Is...>) {
+  return {&compute<Is>...};
+}
+
+//
+// Concept
+//
+
+template <typename T>
+concept Runnable = requires(const T& t, int x) {
+  { t.run(x) } -> std::same_as<int>;
+};
+
+template <Runnable T>
+unsigned run_batch(const std::vector<T>& items, int x) {
+  unsigned sum = 0;
+  for (const auto& item : items) {
+    sum += item.run(x++);
+  }
+  return sum;
+}
+
+template <typename Seq>
+struct segregated_of;
+
+template <size_t... Is>
+struct segregated_of<std::index_sequence<Is...>> {
+  using type = std::tuple<std::vector<Plain<Is>>...>;
+};
+
+//
+// Suite
+//
+
+constexpr size_t num_objects = 1000000;
+constexpr int rounds = 10;
+
+struct result {
+  double ns_per_call;
+  double misses_per_call;
+};
+
+template <typename F>
+result measure(branch_miss_counter& counter, F&& f) {
+  volatile unsigned sink = f();  // Warm up
+  counter.start();
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    sink = f();
+  }
+  auto ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  auto misses = counter.stop();
+  (void)sink;
+  constexpr double calls = double(num_objects) * rounds;
+  return {ns / calls, misses / calls};
+}
+
+template <size_t N>
+void run_suite(branch_miss_counter& counter, bool shuffled) {
+  using seq = std::make_index_sequence<N>;
+  // The kinds of objects, evenly distributed
+  std::vector<uint32_t> kinds(num_objects);
+  for (size_t i = 0; i < num_objects; ++i) {
+    kinds[i] = static_cast<uint32_t>(i * N / num_objects);
+  }
+  if (shuffled) {
+    std::shuffle(kinds.begin(), kinds.end(), std::mt19937(42));
+  }
+  //
+  // Build the collections
+  //
+  std::vector<std::unique_ptr<BaseClass>> owners;
+  std::vector<BaseClass*> objects;
+  std::vector<Tagged> records;
+  std::vector<typename variant_of<seq>::type> variants;
+  typename segregated_of<seq>::type segregated;
+  for (size_t i = 0; i < num_objects; ++i) {
+    int value = static_cast<int>(i & 0xff);
+    [&]<size_t... Is>(std::index_sequence<Is...>) {
+      ((kinds[i] == Is && (owners.emplace_back(std::make_unique<SubClass<Is>>(value)),
+                           variants.emplace_back(Plain<Is>{value}),
+                           std::get<Is>(segregated).push_back(Plain<Is>{value}), true)) ||
+       ...);
+    }(seq{});
+    objects.push_back(owners.back().get());
+    records.push_back({kinds[i], value});
+  }
+  static constexpr auto table = make_table(seq{});
+  //
+  // Run
+  //
+  std::vector<std::pair<const char*, result>> results;
+  results.emplace_back("virtual", measure(counter, [&] {
+                         unsigned sum = 0;
+                         int x = 0;
+                         for (auto ptr : objects) {
+                           sum += ptr->run(x++);
+                         }
+                         return sum;
+                       }));
+  results.emplace_back("crtp", measure(counter, [&] {
+                         unsigned sum = 0;
+                         int x = 0;
+                         for (const auto& record : records) {
+                           sum += crtp_run(record, x++, seq{});
+                         }
+                         return sum;
+                       }));
+  results.emplace_back("variant", measure(counter, [&] {
+                         unsigned sum = 0;
+                         int x = 0;
+                         for (const auto& v : variants) {
+                           sum += std::visit([x](const auto& obj) { return obj.run(x); }, v);
+                           ++x;
+                         }
+                         return sum;
+                       }));
+  results.emplace_back("fnptr", measure(counter, [&] {
+                         unsigned sum = 0;
+                         int x = 0;
+                         for (const auto& record : records) {
+                           sum += table[record.kind](record.value, x++);
+                         }
+                         return sum;
+                       }));
+  results.emplace_back("concept", measure(counter, [&] {
+                         unsigned sum = 0;
+                         std::apply([&sum](const auto&... items) { ((sum += run_batch(items, 0)), ...); },
+                                    segregated);
+                         return sum;
+                       }));
+  //
+  // Report
+  //
+  std::cout << std::setw(3) << N << " types " << (shuffled ? "shuffled" : "sorted  ");
+  for (const auto& [name, r] : results) {
+    std::cout << " | " << name << " " << std::fixed << std::setprecision(2) << r.ns_per_call << "ns";
+    if (counter.valid()) {
+      std::cout << " " << std::setprecision(3) << r.misses_per_call << "bm";
+    }
+  }
+  std::cout << std::endl;
+}
+
+int main() {
+  branch_miss_counter counter;
+  std::cout << "ns/call and branch misses/call (bm)" << (counter.valid() ? "" : ", branch misses: n/a") << std::endl;
+  for (bool shuffled : {false, true}) {
+    run_suite<2>(counter, shuffled);
+    run_suite<8>(counter, shuffled);
+    run_suite<64>(counter, shuffled);
+  }
+  return 0;
+}
+
+/*
+Outputs (-O2, the numbers vary by machine, perf events are not permitted in this sandbox):
+ns/call and branch misses/call (bm), branch misses: n/a
+  2 types sorted   | virtual 4.23ns | crtp 1.51ns | variant 1.49ns | fnptr 1.80ns | concept 0.75ns
+  8 types sorted   | virtual 3.32ns | crtp 1.59ns | variant 2.08ns | fnptr 1.87ns | concept 0.70ns
+ 64 types sorted   | virtual 3.15ns | crtp 4.15ns | variant 2.29ns | fnptr 2.86ns | concept 0.82ns
+  2 types shuffled | virtual 11.54ns | crtp 7.30ns | variant 6.73ns | fnptr 8.36ns | concept 0.54ns
+  8 types shuffled | virtual 15.92ns | crtp 12.10ns | variant 13.18ns | fnptr 12.97ns | concept 0.91ns
+ 64 types shuffled | virtual 17.53ns | crtp 15.54ns | variant 13.19ns | fnptr 13.40ns | concept 0.76ns
+*/
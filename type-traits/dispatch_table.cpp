@@ -0,0 +1,234 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 18:11:09
+ *
+ * File Name: dispatch_table.cpp
+ * Description:
+ *
+ *  From a runtime index to the compile time specializations of template.cpp, without a hand-written switch.
+ *
+ *  `dispatch<N>(index, f)` builds a constexpr table of `f.template operator()<I>` for I in [0, N), and calls the entry
+ *  of the index. `dispatch<N, M, ...>({i, j, ...}, f)` does the same for multiple dimensions (e.g. type x unroll
+ *  factor) in one flat table. One runtime decision per batch then selects a fully specialized inner loop.
+ *
+ */
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// Dispatch
+//
+
+template <size_t... Ns>
+struct dispatch_shape {
+  static constexpr size_t rank = sizeof...(Ns);
+  static constexpr size_t size = (Ns * ... * 1);
+  static constexpr std::array<size_t, rank> extents{Ns...};
+
+  // Row-major: the last dimension is contiguous
+  static constexpr size_t stride(size_t dim) {
+    size_t result = 1;
+    for (size_t i = dim + 1; i < rank; ++i) {
+      result *= extents[i];
+    }
+    return result;
+  }
+
+  // The index on dimension `dim` of the flat index
+  static constexpr size_t index_of(size_t flat, size_t dim) { return flat / stride(dim) % extents[dim]; }
+
+  static size_t flat_index(const std::array<size_t, rank>& indexes) {
+    size_t flat = 0;
+    for (size_t dim = 0; dim < rank; ++dim) {
+      if (indexes[dim] >= extents[dim]) {
+        throw std::out_of_range("dispatch index out of range");
+      }
+      flat += indexes[dim] * stride(dim);
+    }
+    return flat;
+  }
+};
+
+template <size_t... Ns, typename F>
+decltype(auto) dispatch(const std::array<size_t, sizeof...(Ns)>& indexes, F&& f) {
+  using shape = dispatch_shape<Ns...>;
+  using dims = std::make_index_sequence<shape::rank>;
+  using function = decltype(f.template operator()<(Ns * 0)...>()) (*)(F&);
+  // One entry per combination of the indexes, built at compile time
+  static constexpr auto table = []<size_t... Ks>(std::index_sequence<Ks...>) {
+    return std::array<function, shape::size>{[]<size_t K>() -> function {
+      return [](F& f) -> decltype(auto) {
+        return [&f]<size_t... Ds>(std::index_sequence<Ds...>) -> decltype(auto) {
+          return f.template operator()<shape::index_of(K, Ds)...>();
+        }(dims{});
+      };
+    }.template operator()<Ks>()...};
+  }(std::make_index_sequence<shape::size>{});
+  return table[shape::flat_index(indexes)](f);
+}
+
+template <size_t N, typename F>
+decltype(auto) dispatch(size_t index, F&& f) {
+  return dispatch<N>(std::array<size_t, 1>{index}, std::forward<F>(f));
+}
+
+//
+// template.cpp
+//
+
+template <size_t I>
+void run() = delete;
+
+template <>
+void run<0>() {
+  std::cout << "Template0::run" << std::endl;
+}
+
+template <>
+void run<1>() {
+  std::cout << "Template1::run" << std::endl;
+}
+
+//
+// Type x unroll factor
+//
+
+using element_types = std::tuple<int8_t, int16_t, int32_t, float>;
+
+constexpr const char* element_type_names[] = {"int8", "int16", "int32", "float"};
+
+constexpr size_t unroll_factors[] = {1, 2, 4, 8};
+
+template <typename T, size_t UNROLL>
+double sum_unrolled(const void* data, size_t size) {
+  auto values = static_cast<const T*>(data);
+  double partial[UNROLL] = {};
+  size_t body = size - size % UNROLL;
+  for (size_t i = 0; i < body; i += UNROLL) {
+    for (size_t j = 0; j < UNROLL; ++j) {
+      partial[j] += values[i + j];
+    }
+  }
+  double sum = 0;
+  for (size_t j = 0; j < UNROLL; ++j) {
+    sum += partial[j];
+  }
+  for (size_t i = body; i < size; ++i) {
+    sum += values[i];
+  }
+  return sum;
+}
+
+//
+// Divide by a runtime divisor vs a compile time one (multiply and shift)
+//
+
+void divide_runtime(const uint32_t* in, uint32_t* out, size_t size, uint32_t divisor) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = in[i] / divisor;
+  }
+}
+
+template <uint32_t DIVISOR>
+void divide_static(const uint32_t* in, uint32_t* out, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    out[i] = in[i] / DIVISOR;
+  }
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage 1: template.cpp from a runtime index
+  //
+  std::cout << "[+] Usage1" << std::endl;
+  for (size_t index : {1, 0}) {
+    dispatch<2>(index, []<size_t I>() { run<I>(); });
+  }
+  //
+  // Usage 2: Two dimensions, the element type and the unroll factor
+  //
+  std::cout << "[+] Usage2" << std::endl;
+  std::vector<int32_t> ints(1000, 3);
+  std::vector<float> floats(1000, 0.5f);
+  // The indexes of element_types and unroll_factors
+  for (auto [type, unroll] : {std::pair{size_t(2), size_t(2)}, std::pair{size_t(3), size_t(3)}}) {
+    const void* data = type == 2 ? static_cast<const void*>(ints.data()) : floats.data();
+    auto sum = dispatch<4, 4>({type, unroll}, [data]<size_t T, size_t U>() {
+      return sum_unrolled<std::tuple_element_t<T, element_types>, unroll_factors[U]>(data, 1000);
+    });
+    std::cout << element_type_names[type] << " x" << unroll_factors[unroll] << ": " << sum << std::endl;
+  }
+  //
+  // Usage 3: Out of range
+  //
+  std::cout << "[+] Usage3" << std::endl;
+  try {
+    dispatch<2>(2, []<size_t I>() { run<I>(); });
+  } catch (const std::out_of_range& e) {
+    std::cout << "main: caught " << e.what() << std::endl;
+  }
+  //
+  // Benchmark: the divisor is known at runtime only
+  //
+  constexpr size_t size = 1 << 20;
+  std::vector<uint32_t> in(size), out1(size), out2(size);
+  for (size_t i = 0; i < size; ++i) {
+    in[i] = static_cast<uint32_t>(i * 2654435761u);
+  }
+  std::cout << "[+] Benchmark: divide " << size << " uint32 (ms, runtime / dispatched)" << std::endl;
+  bool ok = true;
+  for (uint32_t divisor : {3u, 7u, 10u, 16u}) {
+    auto runtime_ms = measure([&] {
+      for (int round = 0; round < 20; ++round) {
+        divide_runtime(in.data(), out1.data(), size, divisor);
+      }
+    });
+    auto static_ms = measure([&] {
+      for (int round = 0; round < 20; ++round) {
+        // One dispatch per batch, the inner loop is specialized for the divisor
+        dispatch<17>(divisor, [&]<size_t D>() {
+          if constexpr (D > 0) {
+            divide_static<D>(in.data(), out2.data(), size);
+          }
+        });
+      }
+    });
+    ok = ok && out1 == out2;
+    std::cout << "divisor " << divisor << ": " << runtime_ms << " / " << static_ms << std::endl;
+  }
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage1
+Template1::run
+Template0::run
+[+] Usage2
+int32 x4: 3000
+float x8: 500
+[+] Usage3
+main: caught dispatch index out of range
+[+] Benchmark: divide 1048576 uint32 (ms, runtime / dispatched)
+divisor 3: 49.6 / 13.3
+divisor 7: 48.8 / 24.1
+divisor 10: 49.4 / 23.1
+divisor 16: 49.2 / 14.3
+OK
+*/
@@ -0,0 +1,421 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 12:40:19
+ *
+ * File Name: expression_templates.cpp
+ * Description:
+ *
+ *  Expression templates: `a + b * c - d` builds a tree of types instead of a temporary array per operator, and the
+ *  assignment evaluates the whole tree in one loop.
+ *
+ *    - Concepts check the operands: the element types must be the same, and the extents must match when they're
+ *      known at compile time (`array<float, 1024>`). Runtime extents are checked once when the node is built.
+ *    - The assignment goes through the algorithm_implementation_selector of optional_type2: the element types with
+ *      simd_traits get a kernel which evaluates the tree on whole vectors (`packet(i)`), the others (e.g.
+ *      std::complex) get the scalar loop.
+ *
+ *  NOTE: A node keeps references to the arrays, so don't keep an expression after its arrays are gone.
+ *  NOTE: gcc 12 doesn't vectorize the hand-fused loop of the benchmark at -O2 (-fopt-info-vec), while the packet
+ *        kernel is vectorized by construction.
+ *
+ */
+
+#include <chrono>
+#include <complex>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+//
+// Vector types, as simd_kernels.cpp
+//
+
+constexpr size_t vector_width = 16;  // Bytes, SSE2 (the x86-64 baseline, no -m flags needed)
+
+template <typename T>
+struct simd_traits {};
+
+template <typename T>
+  requires((std::integral<T> || std::floating_point<T>) && !std::same_as<T, bool> && sizeof(T) <= 8)
+struct simd_traits<T> {
+  typedef T vector __attribute__((vector_size(vector_width), __may_alias__));
+  typedef T unaligned_vector __attribute__((vector_size(vector_width), __may_alias__, aligned(alignof(T))));
+
+  static constexpr size_t lanes = vector_width / sizeof(T);
+
+  static vector loadu(const T* ptr) { return *reinterpret_cast<const unaligned_vector*>(ptr); }
+
+  static void storeu(T* ptr, vector v) { *reinterpret_cast<unaligned_vector*>(ptr) = v; }
+
+  static vector splat(T value) {
+    vector v;
+    for (size_t i = 0; i < lanes; ++i) {
+      v[i] = value;
+    }
+    return v;
+  }
+};
+
+template <typename T>
+concept HasOptimizedCodes = requires { typename simd_traits<T>::vector; };
+
+//
+// Expressions
+//
+
+template <typename E>
+concept Expression = requires(const E& e, size_t i) {
+  typename E::value_type;
+  { E::extent } -> std::convertible_to<size_t>;
+  { e.size() } -> std::same_as<size_t>;
+  { e[i] } -> std::convertible_to<typename E::value_type>;
+};
+
+template <typename L, typename R>
+concept SameElement = std::same_as<typename L::value_type, typename R::value_type>;
+
+template <typename L, typename R>
+concept CompatibleExtent =
+    L::extent == std::dynamic_extent || R::extent == std::dynamic_extent || L::extent == R::extent;
+
+template <typename T>
+struct aligned_allocator {
+  using value_type = T;
+
+  aligned_allocator() = default;
+
+  template <typename U>
+  aligned_allocator(const aligned_allocator<U>&) noexcept {}
+
+  T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(vector_width))); }
+
+  void deallocate(T* ptr, size_t) noexcept { ::operator delete(ptr, std::align_val_t(vector_width)); }
+
+  friend bool operator==(const aligned_allocator&, const aligned_allocator&) noexcept { return true; }
+};
+
+template <typename T, size_t EXTENT = std::dynamic_extent>
+class array;
+
+// A scalar operand, broadcast to any size
+template <typename T>
+class scalar {
+ public:
+  using value_type = T;
+  static constexpr size_t extent = std::dynamic_extent;
+
+  explicit scalar(T value) : value_(value) {}
+
+  size_t size() const { return 0; }
+
+  T operator[](size_t) const { return value_; }
+
+  auto packet(size_t) const
+    requires HasOptimizedCodes<T>
+  {
+    return simd_traits<T>::splat(value_);
+  }
+
+ private:
+  T value_;
+};
+
+template <typename E>
+struct is_scalar : std::false_type {};
+
+template <typename T>
+struct is_scalar<scalar<T>> : std::true_type {};
+
+// The arrays are kept by reference, the nodes by value
+template <typename E>
+using operand = std::conditional_t<std::is_same_v<E, array<typename E::value_type, E::extent>>, const E&, E>;
+
+template <typename Op, Expression L, Expression R>
+class binary_expression {
+ public:
+  using value_type = typename L::value_type;
+  static constexpr size_t extent = L::extent != std::dynamic_extent ? L::extent : R::extent;
+
+  binary_expression(const L& left, const R& right) : left_(left), right_(right) {
+    if constexpr (!is_scalar<L>::value && !is_scalar<R>::value) {
+      if (left.size() != right.size()) {
+        throw std::invalid_argument("expression: the sizes mismatch");
+      }
+    }
+  }
+
+  size_t size() const { return is_scalar<L>::value ? right_.size() : left_.size(); }
+
+  value_type operator[](size_t i) const { return Op{}(left_[i], right_[i]); }
+
+  // std::plus<> and the others work on the vector types as well
+  auto packet(size_t i) const
+    requires HasOptimizedCodes<value_type>
+  {
+    return Op{}(left_.packet(i), right_.packet(i));
+  }
+
+ private:
+  operand<L> left_;
+  operand<R> right_;
+};
+
+#define DEFINE_OPERATOR(OP, FUNCTION)                                                          \
+  template <Expression L, Expression R>                                                        \
+    requires SameElement<L, R> && CompatibleExtent<L, R>                                       \
+  auto operator OP(const L& left, const R& right) {                                            \
+    return binary_expression<FUNCTION, L, R>(left, right);                                     \
+  }                                                                                            \
+                                                                                               \
+  template <Expression L>                                                                      \
+  auto operator OP(const L& left, std::type_identity_t<typename L::value_type> right) {        \
+    return binary_expression<FUNCTION, L, scalar<typename L::value_type>>(left, scalar(right)); \
+  }                                                                                            \
+                                                                                               \
+  template <Expression R>                                                                      \
+  auto operator OP(std::type_identity_t<typename R::value_type> left, const R& right) {        \
+    return binary_expression<FUNCTION, scalar<typename R::value_type>, R>(scalar(left), right); \
+  }
+
+DEFINE_OPERATOR(+, std::plus<>)
+DEFINE_OPERATOR(-, std::minus<>)
+DEFINE_OPERATOR(*, std::multiplies<>)
+DEFINE_OPERATOR(/, std::divides<>)
+
+#undef DEFINE_OPERATOR
+
+//
+// Evaluation kernels, selected as optional_type2.cpp
+//
+
+template <typename T>
+struct algorithm_implementation {
+  struct implementation {
+    static constexpr const char* name = "scalar";
+
+    template <typename E>
+    static void assign(T* out, const E& expr, size_t size) {
+      for (size_t i = 0; i < size; ++i) {
+        out[i] = expr[i];
+      }
+    }
+  };
+};
+
+template <typename T>
+struct algorithm_implementation_traits {
+  algorithm_implementation_traits() = delete;
+};
+
+template <HasOptimizedCodes T>
+struct algorithm_implementation_traits<T> {
+  struct implementation {
+    static constexpr const char* name = "simd";
+
+    template <typename E>
+    static void assign(T* out, const E& expr, size_t size) {
+      using simd = simd_traits<T>;
+      size_t i = 0;
+      for (; i + simd::lanes <= size; i += simd::lanes) {
+        simd::storeu(out + i, expr.packet(i));
+      }
+      for (; i < size; ++i) {
+        out[i] = expr[i];
+      }
+    }
+  };
+};
+
+template <typename T>
+concept is_algorithm_implementation_specialized = requires { algorithm_implementation_traits<T>(); };
+
+template <typename T>
+using algorithm_implementation_selector =
+    typename std::conditional_t<is_algorithm_implementation_specialized<T>, algorithm_implementation_traits<T>,
+                                algorithm_implementation<T>>;
+
+//
+// Array
+//
+
+template <typename T, size_t EXTENT>
+class array {
+ public:
+  using value_type = T;
+  static constexpr size_t extent = EXTENT;
+
+  explicit array(size_t size = EXTENT, T value = T()) : data_(size, value) {
+    if (EXTENT != std::dynamic_extent && size != EXTENT) {
+      throw std::invalid_argument("array: the size mismatches the extent");
+    }
+  }
+
+  template <Expression E>
+    requires SameElement<array, E> && CompatibleExtent<array, E>
+  array(const E& expr) : array(expr.size()) {
+    *this = expr;
+  }
+
+  // One pass over the whole tree, no temporaries
+  template <Expression E>
+    requires SameElement<array, E> && CompatibleExtent<array, E>
+  array& operator=(const E& expr) {
+    if (expr.size() != size()) {
+      throw std::invalid_argument("array: the sizes mismatch");
+    }
+    algorithm_implementation_selector<T>::implementation::assign(data_.data(), expr, size());
+    return *this;
+  }
+
+  size_t size() const { return data_.size(); }
+
+  T* data() { return data_.data(); }
+
+  T& operator[](size_t i) { return data_[i]; }
+
+  T operator[](size_t i) const { return data_[i]; }
+
+  auto packet(size_t i) const
+    requires HasOptimizedCodes<T>
+  {
+    return simd_traits<T>::loadu(data_.data() + i);
+  }
+
+ private:
+  std::vector<T, aligned_allocator<T>> data_;
+};
+
+//
+// Naive: a temporary per operator
+//
+
+namespace naive {
+
+template <typename T, typename Op>
+std::vector<T> apply(const std::vector<T>& a, const std::vector<T>& b, Op op) {
+  std::vector<T> result(a.size());
+  for (size_t i = 0; i < a.size(); ++i) {
+    result[i] = op(a[i], b[i]);
+  }
+  return result;
+}
+
+template <typename T>
+std::vector<T> operator+(const std::vector<T>& a, const std::vector<T>& b) {
+  return apply(a, b, std::plus<>());
+}
+
+template <typename T>
+std::vector<T> operator-(const std::vector<T>& a, const std::vector<T>& b) {
+  return apply(a, b, std::minus<>());
+}
+
+template <typename T>
+std::vector<T> operator*(const std::vector<T>& a, const std::vector<T>& b) {
+  return apply(a, b, std::multiplies<>());
+}
+
+}  // namespace naive
+
+//
+// Test
+//
+
+template <typename L, typename R>
+concept Addable = requires(const L& left, const R& right) { left + right; };
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+void run_benchmark(size_t size, size_t rounds) {
+  using naive::operator+, naive::operator-, naive::operator*;
+  std::vector<float> va(size), vb(size), vc(size), vd(size);
+  array<float> a(size), b(size), c(size), d(size), out(size);
+  for (size_t i = 0; i < size; ++i) {
+    a[i] = va[i] = float(i % 7);
+    b[i] = vb[i] = float(i % 5) * 0.5f;
+    c[i] = vc[i] = float(i % 3) + 1.0f;
+    d[i] = vd[i] = float(i % 11) * 0.25f;
+  }
+  std::vector<float> naive_out, fused_out(size);
+  auto naive_ns = measure([&] {
+    for (size_t round = 0; round < rounds; ++round) {
+      naive_out = va + vb * vc - vd;
+    }
+  });
+  auto fused_ns = measure([&] {
+    for (size_t round = 0; round < rounds; ++round) {
+      for (size_t i = 0; i < size; ++i) {
+        fused_out[i] = va[i] + vb[i] * vc[i] - vd[i];
+      }
+    }
+  });
+  auto expr_ns = measure([&] {
+    for (size_t round = 0; round < rounds; ++round) {
+      out = a + b * c - d;
+    }
+  });
+  bool ok = true;
+  for (size_t i = 0; i < size; ++i) {
+    ok = ok && naive_out[i] == fused_out[i] && fused_out[i] == out[i];
+  }
+  auto per_element = [&](double ns) { return ns / double(size * rounds); };
+  std::cout << size << " floats: temporaries " << per_element(naive_ns) << " / hand-fused " << per_element(fused_ns)
+            << " / expression " << per_element(expr_ns) << (ok ? "" : " MISMATCH") << std::endl;
+  if (!ok) {
+    std::exit(1);
+  }
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  array<float, 8> x(8, 1.0f), y(8, 2.0f);
+  array<float, 8> z = x * 3.0f + y / 2.0f;
+  std::cout << "z[0]:" << z[0] << " kernel:" << algorithm_implementation_selector<float>::implementation::name
+            << std::endl;
+  array<std::complex<double>> p(3, {1, 1}), q(3, {0, 2});
+  array<std::complex<double>> r = p * q + p;
+  std::cout << "r[0]:" << r[0]
+            << " kernel:" << algorithm_implementation_selector<std::complex<double>>::implementation::name
+            << std::endl;
+  // Rejected at compile time
+  static_assert(!Addable<array<float, 8>, array<float, 4>>);
+  static_assert(!Addable<array<float>, array<double>>);
+  static_assert(Addable<array<float, 8>, array<float>>);
+  try {
+    array<int> u(4), v(5);
+    array<int> w = u + v;
+  } catch (const std::invalid_argument& e) {
+    std::cout << "main: caught " << e.what() << std::endl;
+  }
+  //
+  // Benchmark: out = a + b * c - d
+  //
+  std::cout << "[+] Benchmark: out = a + b * c - d (ns/element)" << std::endl;
+  run_benchmark(1000, 100000);
+  run_benchmark(4000000, 25);
+  return 0;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+z[0]:4 kernel:simd
+r[0]:(-1,3) kernel:scalar
+main: caught expression: the sizes mismatch
+[+] Benchmark: out = a + b * c - d (ns/element)
+1000 floats: temporaries 2.01 / hand-fused 0.98 / expression 0.23
+4000000 floats: temporaries 4.41 / hand-fused 1.51 / expression 1.04
+*/
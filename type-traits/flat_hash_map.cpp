@@ -0,0 +1,684 @@
+/* Author: lipixun
+ * Created Time : 2026-10-21 16:32:08
+ *
+ * File Name: flat_hash_map.cpp
+ * Description:
+ *
+ *  Hashing with the opt-in pattern of example0, and an open addressing hash map on top of it.
+ *
+ *  `contiguously_hashable<T>` tells that the bytes of T are all of its value: two objects are equal if and only if
+ *  their bytes are equal. It's deduced for the types without padding (integers, enums, pointers, structs of them)
+ *  and for the pairs of such types, and a type could opt in or out by specializing it. `hash_value(v)` then hashes:
+ *
+ *    - A contiguously hashable object as raw bytes.
+ *    - A contiguous range of contiguously hashable elements (std::string, std::string_view, std::vector<int>, ...)
+ *      as the bytes of all of the elements, so std::string and std::string_view have the same hash.
+ *    - A type with `fields()` (returns a std::tie of the members) field by field.
+ *    - Anything else by std::hash.
+ *
+ *  The bytes are hashed 16 at a time with 64x64 -> 128 bits multiplications, and a key of 8 or 16 bytes is two
+ *  multiplications in total.
+ *
+ *  `flat_hash_map<K, V>` stores the pairs in one array, plus one control byte per slot: 0x80 for an empty slot, or
+ *  7 bits of the hash for a full one. A lookup starts at the home slot of the hash, compares 16 control bytes with the
+ *  7 bits at once (SSE2), and only the keys of the matching bytes are compared. It's linear probing, so an erase
+ *  shifts the following elements of the cluster back (instead of leaving a tombstone), and a lookup stops at the
+ *  first group which has an empty slot. `find`, `contains`, `try_emplace` and `erase` take any key type which could
+ *  be compared with K when the hasher and the key_equal are transparent (e.g. std::string_view for std::string keys).
+ *
+ *  NOTE: The key must not be modified through an iterator, and erasing invalidates all of the iterators (since the
+ *  elements are shifted).
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+//
+// The trait
+//
+
+template <typename T>
+struct contiguously_hashable : std::bool_constant<std::has_unique_object_representations_v<T>> {};
+
+template <typename A, typename B>
+struct contiguously_hashable<std::pair<A, B>>
+    : std::bool_constant<contiguously_hashable<A>::value && contiguously_hashable<B>::value &&
+                         sizeof(std::pair<A, B>) == sizeof(A) + sizeof(B)> {};
+
+// Views are trivially copyable, but their value is the elements they refer to
+template <typename C, typename Traits>
+struct contiguously_hashable<std::basic_string_view<C, Traits>> : std::false_type {};
+
+template <typename T, size_t N>
+struct contiguously_hashable<std::span<T, N>> : std::false_type {};
+
+template <typename T>
+inline constexpr bool contiguously_hashable_v = contiguously_hashable<T>::value;
+
+//
+// Hash
+//
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+  unsigned __int128 r = static_cast<unsigned __int128>(a) * b;
+  return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t load_u64(const uint8_t* p) {
+  uint64_t value;
+  std::memcpy(&value, p, 8);
+  return value;
+}
+
+inline uint64_t load_u32(const uint8_t* p) {
+  uint32_t value;
+  std::memcpy(&value, p, 4);
+  return value;
+}
+
+constexpr uint64_t hash_secret[] = {0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull,
+                                    0x589965cc75374cc3ull};
+
+// Overlapped loads for the short inputs, and two independent lanes of 16 bytes for the long ones
+inline uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0) {
+  auto p = static_cast<const uint8_t*>(data);
+  seed ^= hash_secret[0];
+  uint64_t a, b;
+  if (size <= 16) {
+    if (size >= 8) {
+      a = load_u64(p);
+      b = load_u64(p + size - 8);
+    } else if (size >= 4) {
+      a = load_u32(p);
+      b = load_u32(p + size - 4);
+    } else if (size > 0) {
+      a = (uint64_t(p[0]) << 16) | (uint64_t(p[size / 2]) << 8) | p[size - 1];
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = size;
+    if (i > 32) {
+      uint64_t seed2 = seed;
+      do {
+        seed = mix(load_u64(p) ^ hash_secret[1], load_u64(p + 8) ^ seed);
+        seed2 = mix(load_u64(p + 16) ^ hash_secret[2], load_u64(p + 24) ^ seed2);
+        p += 32;
+        i -= 32;
+      } while (i > 32);
+      seed ^= seed2;
+    }
+    if (i > 16) {
+      seed = mix(load_u64(p) ^ hash_secret[1], load_u64(p + 8) ^ seed);
+      p += 16;
+      i -= 16;
+    }
+    // The last 16 bytes, overlapped with the ones hashed above
+    a = load_u64(p + i - 16);
+    b = load_u64(p + i - 8);
+  }
+  return mix(hash_secret[1] ^ size, mix(a ^ hash_secret[1], b ^ seed));
+}
+
+template <typename T>
+concept has_fields = requires(const T& v) { v.fields(); };
+
+template <typename R>
+concept contiguously_hashable_range =
+    std::ranges::contiguous_range<R> && std::ranges::sized_range<R> &&
+    contiguously_hashable_v<std::ranges::range_value_t<R>>;
+
+template <typename T>
+size_t hash_value(const T& v) {
+  if constexpr (contiguously_hashable_v<T>) {
+    return hash_bytes(std::addressof(v), sizeof(T));
+  } else if constexpr (contiguously_hashable_range<T>) {
+    return hash_bytes(std::ranges::data(v), std::ranges::size(v) * sizeof(std::ranges::range_value_t<T>));
+  } else if constexpr (has_fields<T>) {
+    return std::apply(
+        [](const auto&... fields) {
+          uint64_t hash = hash_secret[3];
+          ((hash = mix(hash ^ hash_value(fields), hash_secret[2])), ...);
+          return hash;
+        },
+        v.fields());
+  } else {
+    return std::hash<T>{}(v);
+  }
+}
+
+template <typename T>
+struct hasher {
+  size_t operator()(const T& v) const noexcept { return hash_value(v); }
+};
+
+// Strings are hashed as characters, so all of std::string, std::string_view and const char* could be looked up
+template <typename C, typename Traits, typename Allocator>
+struct hasher<std::basic_string<C, Traits, Allocator>> {
+  using is_transparent = void;
+
+  size_t operator()(std::basic_string_view<C, Traits> v) const noexcept { return hash_value(v); }
+};
+
+//
+// The map
+//
+
+template <typename K, typename V, typename Hash = hasher<K>, typename KeyEqual = std::equal_to<>>
+class flat_hash_map {
+ public:
+  using key_type = K;
+  using mapped_type = V;
+  using value_type = std::pair<K, V>;
+
+  static constexpr size_t group_width = 16;
+
+  // Any key with transparent Hash and KeyEqual, or K itself
+  template <typename Q>
+  static constexpr bool lookup_key = std::same_as<Q, K> || (requires {
+                                       typename Hash::is_transparent;
+                                       typename KeyEqual::is_transparent;
+                                     });
+
+  template <bool Const>
+  class basic_iterator {
+   public:
+    using difference_type = std::ptrdiff_t;
+    using value_type = flat_hash_map::value_type;
+    using reference = std::conditional_t<Const, const value_type&, value_type&>;
+
+    basic_iterator() = default;
+
+    reference operator*() const { return map_->slots_[index_]; }
+
+    auto operator->() const { return &map_->slots_[index_]; }
+
+    basic_iterator& operator++() {
+      index_ = map_->next_full(index_ + 1);
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      auto it = *this;
+      ++*this;
+      return it;
+    }
+
+    bool operator==(const basic_iterator& other) const { return index_ == other.index_; }
+
+   private:
+    friend flat_hash_map;
+
+    using map_pointer = std::conditional_t<Const, const flat_hash_map*, flat_hash_map*>;
+
+    basic_iterator(map_pointer map, size_t index) : map_(map), index_(index) {}
+
+    map_pointer map_ = nullptr;
+    size_t index_ = 0;
+  };
+
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  flat_hash_map() = default;
+
+  flat_hash_map(const flat_hash_map&) = delete;
+
+  flat_hash_map(flat_hash_map&& other) noexcept
+      : ctrl_(std::exchange(other.ctrl_, nullptr)),
+        slots_(std::exchange(other.slots_, nullptr)),
+        capacity_(std::exchange(other.capacity_, 0)),
+        size_(std::exchange(other.size_, 0)) {}
+
+  flat_hash_map& operator=(flat_hash_map other) noexcept {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+
+  ~flat_hash_map() { release(); }
+
+  size_t size() const noexcept { return size_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  size_t capacity() const noexcept { return capacity_; }
+
+  iterator begin() { return {this, next_full(0)}; }
+
+  iterator end() { return {this, capacity_}; }
+
+  const_iterator begin() const { return {this, next_full(0)}; }
+
+  const_iterator end() const { return {this, capacity_}; }
+
+  // Make room for n elements without rehashing
+  void reserve(size_t n) {
+    size_t capacity = group_width;
+    while (capacity * max_load_numerator / max_load_denominator < n) {
+      capacity *= 2;
+    }
+    if (capacity > capacity_) {
+      rehash(capacity);
+    }
+  }
+
+  template <typename Q>
+    requires lookup_key<Q>
+  iterator find(const Q& key) {
+    return {this, find_index(key)};
+  }
+
+  template <typename Q>
+    requires lookup_key<Q>
+  const_iterator find(const Q& key) const {
+    return {this, find_index(key)};
+  }
+
+  template <typename Q>
+    requires lookup_key<Q>
+  bool contains(const Q& key) const {
+    return find_index(key) != capacity_;
+  }
+
+  // Insert {key, V(args...)} when the key is not found, K is only constructed then
+  template <typename Q, typename... Args>
+    requires lookup_key<std::remove_cvref_t<Q>> && std::constructible_from<K, Q&&>
+  std::pair<iterator, bool> try_emplace(Q&& key, Args&&... args) {
+    size_t hash = Hash{}(key);
+    if (size_t index = find_index(key, hash); index != capacity_) {
+      return {{this, index}, false};
+    }
+    if ((size_ + 1) * max_load_denominator > capacity_ * max_load_numerator) {
+      rehash(capacity_ ? capacity_ * 2 : group_width);
+    }
+    size_t index = insert_index(hash);
+    std::construct_at(slots_ + index, std::piecewise_construct, std::forward_as_tuple(std::forward<Q>(key)),
+                      std::forward_as_tuple(std::forward<Args>(args)...));
+    set_ctrl(index, h2(hash));
+    ++size_;
+    return {{this, index}, true};
+  }
+
+  std::pair<iterator, bool> insert(value_type value) {
+    return try_emplace(std::move(value.first), std::move(value.second));
+  }
+
+  V& operator[](const K& key) { return try_emplace(key).first->second; }
+
+  V& operator[](K&& key) { return try_emplace(std::move(key)).first->second; }
+
+  // Erase without a tombstone: the following elements of the cluster, which are not at their home slot, are
+  // shifted back to fill the hole
+  template <typename Q>
+    requires lookup_key<Q>
+  size_t erase(const Q& key) {
+    size_t hole = find_index(key);
+    if (hole == capacity_) {
+      return 0;
+    }
+    size_t mask = capacity_ - 1;
+    std::destroy_at(slots_ + hole);
+    for (size_t i = (hole + 1) & mask; ctrl_[i] != empty_slot; i = (i + 1) & mask) {
+      size_t home = h1(Hash{}(slots_[i].first)) & mask;
+      // The element could move to the hole if the hole is between its home and i
+      if (((i - home) & mask) >= ((i - hole) & mask)) {
+        std::construct_at(slots_ + hole, std::move(slots_[i]));
+        std::destroy_at(slots_ + i);
+        set_ctrl(hole, ctrl_[i]);
+        hole = i;
+      }
+    }
+    set_ctrl(hole, empty_slot);
+    --size_;
+    return 1;
+  }
+
+  void clear() {
+    for (size_t i = 0; i < capacity_; ++i) {
+      if (ctrl_[i] != empty_slot) {
+        std::destroy_at(slots_ + i);
+      }
+    }
+    if (ctrl_) {
+      std::memset(ctrl_, empty_slot, capacity_ + group_width);
+    }
+    size_ = 0;
+  }
+
+ private:
+  static constexpr uint8_t empty_slot = 0x80;
+  static constexpr size_t max_load_numerator = 3;
+  static constexpr size_t max_load_denominator = 4;
+
+  static size_t h1(size_t hash) { return hash >> 7; }
+
+  static uint8_t h2(size_t hash) { return hash & 0x7F; }
+
+  // The bits of the bytes in ctrl_[index, index + 16) equal to byte
+  static uint32_t match(const uint8_t* ctrl, uint8_t byte) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(byte))));
+#else
+    uint32_t bits = 0;
+    for (size_t i = 0; i < group_width; ++i) {
+      bits |= uint32_t(ctrl[i] == byte) << i;
+    }
+    return bits;
+#endif
+  }
+
+  // The first group_width bytes are copied after the end, so a group could be loaded from any slot
+  void set_ctrl(size_t index, uint8_t byte) {
+    ctrl_[index] = byte;
+    if (index < group_width) {
+      ctrl_[capacity_ + index] = byte;
+    }
+  }
+
+  template <typename Q>
+  size_t find_index(const Q& key) const {
+    return capacity_ ? find_index(key, Hash{}(key)) : capacity_;
+  }
+
+  template <typename Q>
+  size_t find_index(const Q& key, size_t hash) const {
+    if (capacity_ == 0) {
+      return 0;
+    }
+    size_t mask = capacity_ - 1;
+    uint8_t tag = h2(hash);
+    for (size_t pos = h1(hash) & mask;; pos = (pos + group_width) & mask) {
+      for (uint32_t bits = match(ctrl_ + pos, tag); bits; bits &= bits - 1) {
+        size_t index = (pos + std::countr_zero(bits)) & mask;
+        if (KeyEqual{}(slots_[index].first, key)) [[likely]] {
+          return index;
+        }
+      }
+      // There's no element after an empty slot, in the probing of this hash
+      if (match(ctrl_ + pos, empty_slot)) {
+        return capacity_;
+      }
+    }
+  }
+
+  // The first empty slot from the home slot
+  size_t insert_index(size_t hash) const {
+    size_t mask = capacity_ - 1;
+    for (size_t pos = h1(hash) & mask;; pos = (pos + group_width) & mask) {
+      if (uint32_t bits = match(ctrl_ + pos, empty_slot)) {
+        return (pos + std::countr_zero(bits)) & mask;
+      }
+    }
+  }
+
+  size_t next_full(size_t index) const {
+    while (index < capacity_ && ctrl_[index] == empty_slot) {
+      ++index;
+    }
+    return index;
+  }
+
+  void rehash(size_t capacity) {
+    flat_hash_map old(std::move(*this));
+    ctrl_ = static_cast<uint8_t*>(std::malloc(capacity + group_width));
+    std::memset(ctrl_, empty_slot, capacity + group_width);
+    slots_ = std::allocator<value_type>().allocate(capacity);
+    capacity_ = capacity;
+    size_ = old.size_;
+    for (size_t i = 0; i < old.capacity_; ++i) {
+      if (old.ctrl_[i] != empty_slot) {
+        // The keys are unique, so it's only the probing for an empty slot
+        size_t hash = Hash{}(old.slots_[i].first);
+        size_t index = insert_index(hash);
+        std::construct_at(slots_ + index, std::move(old.slots_[i]));
+        set_ctrl(index, h2(hash));
+      }
+    }
+  }
+
+  void release() {
+    if (ctrl_) {
+      clear();
+      std::free(ctrl_);
+      std::allocator<value_type>().deallocate(slots_, capacity_);
+    }
+  }
+
+  uint8_t* ctrl_ = nullptr;
+  value_type* slots_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+};
+
+//
+// Examples
+//
+
+struct point {
+  int32_t x, y;
+
+  bool operator==(const point&) const = default;
+};
+
+// Padding after side, so it's not deduced. The values are also equal with different bytes of the padding.
+struct order {
+  uint64_t id;
+  char side;
+
+  bool operator==(const order&) const = default;
+
+  auto fields() const { return std::tie(id, side); }
+};
+
+struct trade_key {
+  std::string symbol;
+  uint32_t account;
+
+  bool operator==(const trade_key&) const = default;
+
+  auto fields() const { return std::tie(symbol, account); }
+};
+
+static_assert(contiguously_hashable_v<uint64_t>);
+static_assert(contiguously_hashable_v<point>);
+static_assert(contiguously_hashable_v<std::pair<int32_t, uint32_t>>);
+static_assert(!contiguously_hashable_v<order>);
+static_assert(!contiguously_hashable_v<double>);  // +0.0 == -0.0
+static_assert(!contiguously_hashable_v<std::pair<char, uint64_t>>);
+static_assert(!contiguously_hashable_v<std::string>);
+static_assert(!contiguously_hashable_v<std::string_view>);
+static_assert(contiguously_hashable_range<std::string>);
+
+//
+// Benchmark
+//
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// insert, find (all hits, then all misses) and erase of n random keys, ns/op. The hits and erases are in another
+// order than the inserts, otherwise the nodes of std::unordered_map are visited in the order they were allocated.
+template <typename Map>
+std::vector<double> run(const std::vector<uint64_t>& keys, const std::vector<uint64_t>& shuffled,
+                        const std::vector<uint64_t>& missing, uint64_t& sum) {
+  Map map;
+  std::vector<double> ns;
+  size_t n = keys.size();
+  ns.push_back(measure([&] {
+                 for (auto key : keys) {
+                   map[key] = key;
+                 }
+               }) /
+               n);
+  ns.push_back(measure([&] {
+                 for (auto key : shuffled) {
+                   auto it = map.find(key);
+                   sum += it != map.end() ? it->second : 1;
+                 }
+               }) /
+               n);
+  ns.push_back(measure([&] {
+                 for (auto key : missing) {
+                   sum += map.find(key) != map.end();
+                 }
+               }) /
+               n);
+  ns.push_back(measure([&] {
+                 for (auto key : shuffled) {
+                   sum += map.erase(key);
+                 }
+               }) /
+               n);
+  sum += map.size();
+  return ns;
+}
+
+int main(int argc, char* argv[]) {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  flat_hash_map<std::string, int> words;
+  for (std::string_view word : {"the", "quick", "brown", "fox", "jumps", "over", "the", "lazy", "dog"}) {
+    ++words[std::string(word)];
+  }
+  // No std::string is constructed for the lookups
+  std::cout << "the: " << words.find(std::string_view("the"))->second << ", cat: " << words.contains("cat")
+            << ", size: " << words.size() << std::endl;
+  words.erase(std::string_view("the"));
+  std::cout << "after erase: " << words.contains("the") << " " << words.contains("fox") << " " << words.size()
+            << std::endl;
+
+  flat_hash_map<point, std::string> points;
+  points.try_emplace(point{1, 2}, "a");
+  points.try_emplace(point{-1, 2}, "b");
+  flat_hash_map<trade_key, double> positions;
+  positions[{"AAPL", 7}] += 100;
+  positions[{"AAPL", 7}] -= 40;
+  positions[{"AAPL", 8}] += 10;
+  std::cout << "point: " << points.find(point{-1, 2})->second << ", position: " << positions.find(trade_key{"AAPL", 7})->second
+            << ", positions: " << positions.size() << std::endl;
+  std::cout << "hash_value(std::string) == hash_value(std::string_view): "
+            << (hash_value(std::string("abcdefghijklmnopqrstuvwxyz")) ==
+                hash_value(std::string_view("abcdefghijklmnopqrstuvwxyz")))
+            << std::endl;
+
+  //
+  // Self check of the shifting erase with random operations
+  //
+  {
+    std::mt19937_64 rng(7);
+    flat_hash_map<uint64_t, uint64_t> map;
+    std::unordered_map<uint64_t, uint64_t> expected;
+    bool ok = true;
+    for (size_t i = 0; i < 1000000; ++i) {
+      // Few distinct keys, so there are many long clusters with erases in the middle
+      uint64_t key = rng() % 5000;
+      if (rng() % 3 == 0) {
+        ok = ok && map.erase(key) == expected.erase(key);
+      } else {
+        map[key] = i;
+        expected[key] = i;
+      }
+    }
+    for (auto& [key, value] : expected) {
+      auto it = map.find(key);
+      ok = ok && it != map.end() && it->second == value;
+    }
+    size_t count = 0;
+    for (auto& entry : map) {
+      ok = ok && expected.contains(entry.first);
+      ++count;
+    }
+    ok = ok && count == expected.size() && map.size() == expected.size();
+    std::cout << "random operations: " << (ok ? "match" : "mismatch") << std::endl;
+    if (!ok) {
+      return 1;
+    }
+  }
+
+  //
+  // Benchmark: uint64_t -> uint64_t, 1e3 ~ 1e7 keys. The largest size is the first argument, e.g. 100000000 (which
+  // needs more than 8GB of memory for std::unordered_map).
+  //
+  size_t max_size = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+  std::cout << "[+] Benchmark: ns/op of flat_hash_map / std::unordered_map" << std::endl;
+  uint64_t sum1 = 0, sum2 = 0;
+  std::mt19937_64 rng(42);
+  for (size_t n = 1000; n <= max_size; n *= 10) {
+    std::vector<uint64_t> keys(n), missing(n);
+    for (size_t i = 0; i < n; ++i) {
+      // Odd keys are inserted, even ones are missing
+      keys[i] = rng() | 1;
+      missing[i] = rng() & ~uint64_t(1);
+    }
+    auto shuffled = keys;
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+    std::vector<double> flat(4), unordered(4);
+    // Repeat the small sizes to run about 1e7 operations
+    size_t rounds = std::max<size_t>(1, 10000000 / n);
+    for (size_t r = 0; r < rounds; ++r) {
+      auto a = run<flat_hash_map<uint64_t, uint64_t>>(keys, shuffled, missing, sum1);
+      auto b = run<std::unordered_map<uint64_t, uint64_t>>(keys, shuffled, missing, sum2);
+      for (size_t i = 0; i < 4; ++i) {
+        flat[i] += a[i] / rounds;
+        unordered[i] += b[i] / rounds;
+      }
+    }
+    std::cout << "n=" << n << ": insert " << flat[0] << " / " << unordered[0] << ", find hit " << flat[1] << " / "
+              << unordered[1] << ", find miss " << flat[2] << " / " << unordered[2] << ", erase " << flat[3] << " / "
+              << unordered[3] << std::endl;
+  }
+  bool ok = sum1 == sum2;
+  std::cout << "sum:" << (ok ? "match" : "mismatch") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+the: 2, cat: 0, size: 8
+after erase: 0 1 7
+point: b, position: 60, positions: 2
+hash_value(std::string) == hash_value(std::string_view): 1
+random operations: match
+[+] Benchmark: ns/op of flat_hash_map / std::unordered_map
+n=1000: insert 39.1149 / 57.6379, find hit 5.90675 / 8.53285, find miss 5.05463 / 12.3024, erase 11.1657 / 32.702
+n=10000: insert 24.0521 / 60.6832, find hit 5.7487 / 20.3787, find miss 5.93921 / 29.6166, erase 29.7374 / 42.7425
+n=100000: insert 39.4718 / 111.125, find hit 23.8355 / 24.9567, find miss 6.91307 / 30.7635, erase 30.3317 / 74.9276
+n=1000000: insert 68.1789 / 361.136, find hit 38.122 / 66.9023, find miss 16.0085 / 75.0925, erase 64.816 / 266.18
+n=10000000: insert 72.7415 / 636.993, find hit 53.511 / 108.432, find miss 28.7267 / 116.817, erase 135.264 / 424.965
+sum:match
+*/
@@ -0,0 +1,703 @@
+/* Author: lipixun
+ * Created Time : 2026-10-21 11:17:45
+ *
+ * File Name: numeric_parsing.cpp
+ * Description:
+ *
+ *  Parsing decimal numbers from text, with the algorithm_implementation_selector of optional_type2:
+ *
+ *    - Integers of all widths: the digits are converted 8 at a time in a 64 bits register (SWAR), and 16 at a time
+ *      with SSE4.1 for the 64 bits types when the CPU has it (checked at runtime, no -m flags are needed). A number
+ *      with more than 19 digits goes to the fallback.
+ *    - float and double: the decimal mantissa (up to 19 digits) and exponent are parsed as above, and converted by
+ *      the Clinger fast path when it's exact, or by the Eisel-Lemire algorithm: the mantissa is multiplied with a 128
+ *      bits approximation of the power of five, and the rare ambiguous cases go to the fallback. The table of the
+ *      powers of five is computed at compile time.
+ *    - The other types (e.g. long double) use std::from_chars.
+ *
+ *  `parse_number(first, last, value)` has the interface of std::from_chars, and `parse_column` parses a column of
+ *  numbers, one per line, or a list of fields.
+ *
+ *  NOTE: A subnormal float result is returned as is, while std::from_chars of libstdc++ reports result_out_of_range.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <immintrin.h>
+
+//
+// Digits
+//
+
+constexpr uint64_t powers_of_ten[] = {1,         10,         100,         1000,         10000,
+                                      100000,    1000000,    10000000,    100000000,    1000000000,
+                                      10000000000ull, 100000000000ull, 1000000000000ull, 10000000000000ull,
+                                      100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+                                      100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull};
+
+// At most 19 digits always fit in uint64_t
+constexpr size_t max_digits = 19;
+
+inline bool is_digit(char c) { return static_cast<unsigned char>(c - '0') <= 9; }
+
+// Little endian, the first character is the lowest byte
+inline uint64_t load_u64(const char* p) {
+  uint64_t value;
+  std::memcpy(&value, p, 8);
+  return value;
+}
+
+// The number of leading digits of 8 characters, no carry crosses the bytes
+inline size_t leading_digits(uint64_t chunk) {
+  constexpr uint64_t high = 0x8080808080808080ull;
+  uint64_t low = chunk & ~high;
+  uint64_t above = low + 0x4646464646464646ull;               // The high bit is set when > '9'
+  uint64_t not_below = (low | high) - 0x3030303030303030ull;  // The high bit is cleared when < '0'
+  uint64_t non_digits = (above | ~not_below | chunk) & high;
+  return non_digits ? std::countr_zero(non_digits) / 8 : 8;
+}
+
+// 8 digits of 0 ~ 9 (not characters), the lowest byte is the most significant one
+inline uint32_t eight_digits_value(uint64_t v) {
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFull) * (100 + (1000000ull << 32))) +
+       (((v >> 16) & 0x000000FF000000FFull) * (1 + (10000ull << 32)))) >>
+      32;
+  return static_cast<uint32_t>(v);
+}
+
+// The 16 digits kernel is built for SSE4.1 regardless of the -m flags, and only called when the CPU has it
+inline bool cpu_has_sse41() {
+  static const bool sse41 = __builtin_cpu_supports("sse4.1");
+  return sse41;
+}
+
+// 16 digits at once, or false when any of them is not a digit
+__attribute__((target("sse4.1"))) bool sixteen_digits_value(const char* p, uint64_t& value) {
+  __m128i digits = _mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8('0'));
+  __m128i valid = _mm_cmpeq_epi8(_mm_max_epu8(digits, _mm_set1_epi8(9)), _mm_set1_epi8(9));
+  if (_mm_movemask_epi8(valid) != 0xFFFF) {
+    return false;
+  }
+  // Pairs, groups of 4, and then groups of 8
+  __m128i t1 = _mm_maddubs_epi16(digits, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+  __m128i t2 = _mm_madd_epi16(t1, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+  __m128i t3 = _mm_packus_epi32(t2, t2);
+  __m128i t4 = _mm_madd_epi16(t3, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+  value = uint64_t(uint32_t(_mm_cvtsi128_si32(t4))) * 100000000 + uint32_t(_mm_extract_epi32(t4, 1));
+  return true;
+}
+
+struct digits_result {
+  const char* ptr;
+  uint64_t value;
+  size_t count;
+  // There are more than max_count digits
+  bool too_many;
+};
+
+// Parse up to max_count (<= 19) digits
+inline digits_result parse_digits(const char* p, const char* last, size_t max_count = max_digits) {
+  const char* start = p;
+  uint64_t value = 0;
+  if (max_count >= 16 && last - p >= 16 && cpu_has_sse41() && sixteen_digits_value(p, value)) {
+    p += 16;
+  }
+  while (last - p >= 8 && size_t(p - start) + 8 <= max_count) {
+    uint64_t chunk = load_u64(p);
+    size_t n = leading_digits(chunk);
+    if (n == 0) {
+      return {p, value, size_t(p - start), false};
+    }
+    // The characters after the digits are shifted out, the borrows of them only go to the higher bytes
+    value = value * powers_of_ten[n] + eight_digits_value((chunk - 0x3030303030303030ull) << (8 * (8 - n)));
+    p += n;
+    if (n < 8) {
+      return {p, value, size_t(p - start), false};
+    }
+  }
+  for (; p != last && is_digit(*p); ++p) {
+    if (size_t(p - start) == max_count) {
+      return {p, value, size_t(p - start), true};
+    }
+    value = value * 10 + (*p - '0');
+  }
+  return {p, value, size_t(p - start), false};
+}
+
+//
+// Eisel-Lemire
+//
+
+template <typename T>
+struct binary_format;
+
+template <>
+struct binary_format<double> {
+  using bits_type = uint64_t;
+  static constexpr int mantissa_explicit_bits = 52;
+  static constexpr int minimum_exponent = -1023;
+  static constexpr int infinite_power = 0x7FF;
+  static constexpr int smallest_power_of_ten = -342;
+  static constexpr int largest_power_of_ten = 308;
+  static constexpr int min_exponent_round_to_even = -4;
+  static constexpr int max_exponent_round_to_even = 23;
+  // Clinger: the mantissa and the power of ten are exact
+  static constexpr int max_exponent_fast_path = 22;
+  static constexpr uint64_t max_mantissa_fast_path = uint64_t(2) << mantissa_explicit_bits;
+  static constexpr double exact_powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+};
+
+template <>
+struct binary_format<float> {
+  using bits_type = uint32_t;
+  static constexpr int mantissa_explicit_bits = 23;
+  static constexpr int minimum_exponent = -127;
+  static constexpr int infinite_power = 0xFF;
+  static constexpr int smallest_power_of_ten = -64;
+  static constexpr int largest_power_of_ten = 38;
+  static constexpr int min_exponent_round_to_even = -17;
+  static constexpr int max_exponent_round_to_even = 10;
+  static constexpr int max_exponent_fast_path = 10;
+  static constexpr uint64_t max_mantissa_fast_path = uint64_t(2) << mantissa_explicit_bits;
+  static constexpr float exact_powers[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+};
+
+constexpr int smallest_power_of_five = binary_format<double>::smallest_power_of_ten;
+constexpr int largest_power_of_five = binary_format<double>::largest_power_of_ten;
+
+// The 128 bits approximations of 5^q (high, low), normalized so that the top bit is set: 5^q truncated for q >= 0,
+// and 2^b / 5^-q rounded up for q < 0, the same as the table of the paper
+constexpr auto power_of_five_128 = [] {
+  // Big integers of 2048 bits, the lowest word first
+  using big = std::array<uint64_t, 32>;
+  auto mul_small = [](big& a, uint64_t m) {
+    unsigned __int128 carry = 0;
+    for (auto& word : a) {
+      carry += static_cast<unsigned __int128>(word) * m;
+      word = static_cast<uint64_t>(carry);
+      carry >>= 64;
+    }
+  };
+  auto div_small = [](big& a, uint64_t d) {
+    unsigned __int128 rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+      unsigned __int128 cur = (rem << 64) | a[i];
+      a[i] = static_cast<uint64_t>(cur / d);
+      rem = cur % d;
+    }
+  };
+  auto bit_length = [](const big& a) -> int {
+    for (size_t i = a.size(); i-- > 0;) {
+      if (a[i]) {
+        return int(i) * 64 + std::bit_width(a[i]);
+      }
+    }
+    return 0;
+  };
+  // The 128 bits of a from the bit at shift (may be negative), as (high, low)
+  auto bits_at = [](const big& a, int shift) -> std::pair<uint64_t, uint64_t> {
+    auto bit = [&](int i) -> uint64_t { return i < 0 ? 0 : (a[i / 64] >> (i % 64)) & 1; };
+    uint64_t high = 0, low = 0;
+    for (int i = 127; i >= 0; --i) {
+      (i >= 64 ? high : low) |= bit(shift + i) << (i % 64);
+    }
+    return {high, low};
+  };
+  auto add_one = [](big& a) {
+    for (auto& word : a) {
+      if (++word != 0) {
+        break;
+      }
+    }
+  };
+
+  std::array<uint64_t, 2 * (largest_power_of_five - smallest_power_of_five + 1)> table{};
+  auto store = [&](int q, std::pair<uint64_t, uint64_t> value) {
+    table[2 * (q - smallest_power_of_five)] = value.first;
+    table[2 * (q - smallest_power_of_five) + 1] = value.second;
+  };
+  big power{};  // 5^n
+  power[0] = 1;
+  big inverse{};  // floor(2^2047 / 5^n)
+  inverse[31] = uint64_t(1) << 63;
+  constexpr int inverse_bits = 2047;
+  for (int n = 0; n <= -smallest_power_of_five; ++n) {
+    int z = bit_length(power);  // 2^z >= 5^n for n > 0
+    if (n <= largest_power_of_five) {
+      store(n, bits_at(power, z - 128));
+    }
+    if (n > 0) {
+      // c = floor(2^b / 5^n) + 1, then the top 128 bits
+      int b = n <= 27 ? z + 127 : 2 * z + 128;
+      big c{};
+      int shift = inverse_bits - b;
+      for (size_t i = 0; i < c.size(); ++i) {
+        size_t word = i + shift / 64;
+        if (word < c.size()) {
+          c[i] = inverse[word] >> (shift % 64);
+          if (shift % 64 && word + 1 < c.size()) {
+            c[i] |= inverse[word + 1] << (64 - shift % 64);
+          }
+        }
+      }
+      add_one(c);
+      store(-n, bits_at(c, std::max(bit_length(c) - 128, 0)));
+    }
+    mul_small(power, 5);
+    div_small(inverse, 5);
+  }
+  return table;
+}();
+
+static_assert(power_of_five_128[0] == 0xeef453d6923bd65aull && power_of_five_128[1] == 0x113faa2906a13b3full);
+static_assert(power_of_five_128[2 * 342] == 0x8000000000000000ull && power_of_five_128[2 * 342 + 1] == 0);
+
+struct adjusted_mantissa {
+  uint64_t mantissa;
+  // A negative power means the result is ambiguous
+  int32_t power2;
+};
+
+// The binary value of w * 10^q, w is not zero
+template <typename T>
+adjusted_mantissa compute_float(int64_t q, uint64_t w) {
+  using format = binary_format<T>;
+  if (q < format::smallest_power_of_ten) {
+    return {0, 0};
+  }
+  if (q > format::largest_power_of_ten) {
+    return {0, format::infinite_power};
+  }
+  int lz = std::countl_zero(w);
+  w <<= lz;
+  // The product with the truncated power of five, the second word only when the first one may carry
+  size_t index = 2 * (q - smallest_power_of_five);
+  auto product = static_cast<unsigned __int128>(w) * power_of_five_128[index];
+  uint64_t high = static_cast<uint64_t>(product >> 64);
+  uint64_t low = static_cast<uint64_t>(product);
+  constexpr uint64_t precision_mask = ~uint64_t(0) >> (format::mantissa_explicit_bits + 3);
+  if ((high & precision_mask) == precision_mask) {
+    auto second = static_cast<unsigned __int128>(w) * power_of_five_128[index + 1];
+    uint64_t second_high = static_cast<uint64_t>(second >> 64);
+    low += second_high;
+    if (second_high > low) {
+      ++high;
+    }
+    if (low == ~uint64_t(0) && (q < -27 || q > 55)) {
+      return {0, -1};
+    }
+  }
+  int upperbit = int(high >> 63);
+  int shift = upperbit + 64 - format::mantissa_explicit_bits - 3;
+  adjusted_mantissa answer;
+  answer.mantissa = high >> shift;
+  // floor(log2(10^q)) + 63
+  int32_t power = (((152170 + 65536) * int32_t(q)) >> 16) + 63;
+  answer.power2 = power + upperbit - lz - format::minimum_exponent;
+  if (answer.power2 <= 0) {
+    // Subnormal
+    if (-answer.power2 + 1 >= 64) {
+      return {0, 0};
+    }
+    answer.mantissa >>= -answer.power2 + 1;
+    answer.mantissa += (answer.mantissa & 1);
+    answer.mantissa >>= 1;
+    answer.power2 = (answer.mantissa < (uint64_t(1) << format::mantissa_explicit_bits)) ? 0 : 1;
+    return answer;
+  }
+  // Exactly halfway, round to even
+  if (low <= 1 && q >= format::min_exponent_round_to_even && q <= format::max_exponent_round_to_even &&
+      (answer.mantissa & 3) == 1 && (answer.mantissa << shift) == high) {
+    answer.mantissa &= ~uint64_t(1);
+  }
+  answer.mantissa += (answer.mantissa & 1);
+  answer.mantissa >>= 1;
+  if (answer.mantissa >= (uint64_t(2) << format::mantissa_explicit_bits)) {
+    answer.mantissa = uint64_t(1) << format::mantissa_explicit_bits;
+    ++answer.power2;
+  }
+  answer.mantissa &= ~(uint64_t(1) << format::mantissa_explicit_bits);
+  if (answer.power2 >= format::infinite_power) {
+    return {0, format::infinite_power};
+  }
+  return answer;
+}
+
+//
+// Implementations, selected as optional_type2.cpp
+//
+
+template <typename T>
+struct algorithm_implementation {
+  struct implementation {
+    static constexpr const char* name = "from_chars";
+
+    static std::from_chars_result parse(const char* first, const char* last, T& value) {
+      return std::from_chars(first, last, value);
+    }
+  };
+};
+
+template <typename T>
+struct algorithm_implementation_traits {
+  algorithm_implementation_traits() = delete;
+};
+
+template <typename T>
+  requires(std::integral<T> && !std::same_as<T, bool>)
+struct algorithm_implementation_traits<T> {
+  struct implementation {
+    static inline const char* const name = sizeof(T) == 8 && cpu_has_sse41() ? "sse4.1+swar" : "swar";
+
+    static std::from_chars_result parse(const char* first, const char* last, T& value) {
+      const char* p = first;
+      bool negative = false;
+      if constexpr (std::is_signed_v<T>) {
+        if (p != last && *p == '-') {
+          negative = true;
+          ++p;
+        }
+      }
+      // The 16 digits kernel only for the types which may have that many digits
+      auto digits = parse_digits(p, last, std::numeric_limits<T>::digits10 + 1 >= 16 ? max_digits : 15);
+      if (digits.count == 0) {
+        return {first, std::errc::invalid_argument};
+      }
+      if (digits.too_many) {
+        return std::from_chars(first, last, value);
+      }
+      uint64_t limit = uint64_t(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+      if (digits.value > limit) {
+        for (p = digits.ptr; p != last && is_digit(*p); ++p) {
+        }
+        return {p, std::errc::result_out_of_range};
+      }
+      using U = std::make_unsigned_t<T>;
+      value = negative ? T(U(0) - U(digits.value)) : T(digits.value);
+      return {digits.ptr, std::errc{}};
+    }
+  };
+};
+
+template <typename T>
+  requires(std::same_as<T, float> || std::same_as<T, double>)
+struct algorithm_implementation_traits<T> {
+  struct implementation {
+    static constexpr const char* name = "eisel-lemire";
+
+    static std::from_chars_result parse(const char* first, const char* last, T& value) {
+      using format = binary_format<T>;
+      const char* p = first;
+      bool negative = p != last && *p == '-';
+      p += negative;
+      // Mantissa, the leading zeros are not significant
+      const char* digits_start = p;
+      for (; p != last && *p == '0'; ++p) {
+      }
+      auto integer = parse_digits(p, last);
+      if (integer.too_many) {
+        return std::from_chars(first, last, value);
+      }
+      p = integer.ptr;
+      uint64_t w = integer.value;
+      size_t significant = integer.count;
+      int64_t exponent = 0;
+      bool has_digits = p != digits_start;
+      if (p != last && *p == '.') {
+        const char* fraction_start = ++p;
+        if (significant == 0) {
+          for (; p != last && *p == '0'; ++p) {
+          }
+        }
+        auto fraction = parse_digits(p, last, max_digits - significant);
+        if (fraction.too_many) {
+          return std::from_chars(first, last, value);
+        }
+        p = fraction.ptr;
+        w = w * powers_of_ten[fraction.count] + fraction.value;
+        exponent -= p - fraction_start;
+        has_digits = has_digits || p != fraction_start;
+      }
+      if (!has_digits) {
+        // inf, nan, or not a number
+        return std::from_chars(first, last, value);
+      }
+      if (p != last && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negative_exponent = e != last && *e == '-';
+        e += (e != last && (*e == '-' || *e == '+'));
+        if (e != last && is_digit(*e)) {
+          int64_t explicit_exponent = 0;
+          for (; e != last && is_digit(*e); ++e) {
+            // Saturated, far beyond the range anyway
+            explicit_exponent = std::min<int64_t>(explicit_exponent * 10 + (*e - '0'), 1 << 20);
+          }
+          exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+          p = e;
+        }
+      }
+      if (w == 0) {
+        value = negative ? -T(0) : T(0);
+        return {p, std::errc{}};
+      }
+      if (exponent >= -format::max_exponent_fast_path && exponent <= format::max_exponent_fast_path &&
+          w <= format::max_mantissa_fast_path) {
+        T result = T(w);
+        result = exponent < 0 ? result / format::exact_powers[-exponent] : result * format::exact_powers[exponent];
+        value = negative ? -result : result;
+        return {p, std::errc{}};
+      }
+      auto answer = compute_float<T>(exponent, w);
+      if (answer.power2 < 0) {
+        return std::from_chars(first, last, value);
+      }
+      if (answer.power2 == format::infinite_power || (answer.power2 == 0 && answer.mantissa == 0)) {
+        return {p, std::errc::result_out_of_range};
+      }
+      auto bits = static_cast<typename format::bits_type>(
+          answer.mantissa | (uint64_t(answer.power2) << format::mantissa_explicit_bits) |
+          (uint64_t(negative) << (sizeof(T) * 8 - 1)));
+      value = std::bit_cast<T>(bits);
+      return {p, std::errc{}};
+    }
+  };
+};
+
+template <typename T>
+concept is_algorithm_implementation_specialized = requires { algorithm_implementation_traits<T>(); };
+
+template <typename T>
+using algorithm_implementation_selector =
+    typename std::conditional_t<is_algorithm_implementation_specialized<T>, algorithm_implementation_traits<T>,
+                                algorithm_implementation<T>>;
+
+//
+// Parsing API
+//
+
+template <typename T>
+std::from_chars_result parse_number(const char* first, const char* last, T& value) {
+  return algorithm_implementation_selector<T>::implementation::parse(first, last, value);
+}
+
+// A column of numbers separated by the delimiter, appended to out
+template <typename T>
+void parse_column(std::string_view text, std::vector<T>& out, char delimiter = '\n') {
+  const char* p = text.data();
+  const char* last = p + text.size();
+  while (p != last) {
+    T value{};
+    auto [ptr, ec] = parse_number(p, last, value);
+    if (ec != std::errc{} || (ptr != last && *ptr != delimiter)) {
+      throw std::invalid_argument("parse_column: invalid number at offset " + std::to_string(p - text.data()));
+    }
+    out.push_back(value);
+    p = ptr == last ? ptr : ptr + 1;
+  }
+}
+
+// Fields which are split already, e.g. a column of CSV
+template <typename T>
+void parse_column(std::span<const std::string_view> fields, std::span<T> out) {
+  if (fields.size() != out.size()) {
+    throw std::invalid_argument("parse_column: size mismatch");
+  }
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const char* last = fields[i].data() + fields[i].size();
+    auto [ptr, ec] = parse_number(fields[i].data(), last, out[i]);
+    if (ec != std::errc{} || ptr != last) {
+      throw std::invalid_argument("parse_column: invalid number at field " + std::to_string(i));
+    }
+  }
+}
+
+//
+// Test
+//
+
+// The same column with std::from_chars
+template <typename T>
+void from_chars_column(std::string_view text, std::vector<T>& out) {
+  const char* p = text.data();
+  const char* last = p + text.size();
+  while (p != last) {
+    T value{};
+    // result_out_of_range of the subnormals is ignored
+    auto [ptr, ec] = std::from_chars(p, last, value);
+    if (ec == std::errc::invalid_argument) {
+      throw std::invalid_argument("from_chars_column: invalid number");
+    }
+    out.push_back(value);
+    p = ptr == last ? ptr : ptr + 1;
+  }
+}
+
+template <typename T>
+std::string to_text(T value) {
+  char buffer[64];
+  auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  return std::string(buffer, ptr);
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Parse a column both ways, check with the reference and print GB/s
+template <typename T, typename Reference>
+bool benchmark(const char* name, const std::vector<std::string>& values, Reference reference) {
+  std::string text;
+  for (auto& v : values) {
+    text += v;
+    text += '\n';
+  }
+  // The best of 5 rounds
+  std::vector<T> fast, slow;
+  fast.reserve(values.size());
+  slow.reserve(values.size());
+  double fast_s = 1e9, slow_s = 1e9;
+  for (int round = 0; round < 5; ++round) {
+    fast.clear();
+    slow.clear();
+    fast_s = std::min(fast_s, measure([&] { parse_column(text, fast); }));
+    slow_s = std::min(slow_s, measure([&] { from_chars_column(text, slow); }));
+  }
+  bool ok = fast.size() == values.size();
+  for (size_t i = 0; ok && i < values.size(); ++i) {
+    T expected = reference(values[i]);
+    ok = std::memcmp(&fast[i], &expected, sizeof(T)) == 0;
+    if (!ok) {
+      std::cout << "mismatch: " << values[i] << std::endl;
+    }
+  }
+  std::cout << name << " (" << algorithm_implementation_selector<T>::implementation::name << "): "
+            << text.size() / fast_s / 1e9 << " GB/s, from_chars: " << text.size() / slow_s / 1e9 << " GB/s"
+            << (ok ? "" : " MISMATCH") << std::endl;
+  return ok;
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  std::string_view line = "42,-17,3.25,1e-3,18446744073709551615";
+  std::vector<std::string_view> fields;
+  for (size_t start = 0, end; start <= line.size(); start = end + 1) {
+    end = std::min(line.find(',', start), line.size());
+    fields.push_back(line.substr(start, end - start));
+  }
+  auto parse = [](std::string_view field, auto& value) {
+    return parse_number(field.data(), field.data() + field.size(), value);
+  };
+  int32_t a = 0, b = 0;
+  double c = 0, d = 0;
+  uint64_t e = 0;
+  parse(fields[0], a);
+  parse(fields[1], b);
+  parse(fields[2], c);
+  parse(fields[3], d);
+  parse(fields[4], e);
+  std::cout << a << " " << b << " " << c << " " << d << " " << e << std::endl;
+  std::vector<double> column(3);
+  std::vector<std::string_view> prices = {"19.99", "0.5", "1250"};
+  parse_column<double>(prices, column);
+  std::cout << "prices: " << column[0] << " " << column[1] << " " << column[2] << std::endl;
+  int8_t small;
+  std::cout << "int8_t of 300: "
+            << (parse("300", small).ec == std::errc::result_out_of_range ? "result_out_of_range" : "parsed")
+            << std::endl;
+  std::cout << "long double: " << algorithm_implementation_selector<long double>::implementation::name << std::endl;
+  //
+  // Benchmark: columns of 1e6 numbers, checked with std::from_chars (integers) and strtod (floats)
+  //
+  constexpr size_t num = 1000000;
+  std::mt19937_64 rng(42);
+  std::vector<std::string> u32, i64, prices_text, doubles, floats;
+  for (size_t i = 0; i < num; ++i) {
+    u32.push_back(to_text(uint32_t(rng())));
+    i64.push_back(to_text(int64_t(rng())));
+    prices_text.push_back(std::to_string(rng() % 10000000 / 100) + "." + std::to_string(10 + rng() % 90));
+    // Random bits, all the exponents and subnormals
+    double x;
+    do {
+      x = std::bit_cast<double>(rng());
+    } while (!std::isfinite(x));
+    doubles.push_back(to_text(x));
+    float y;
+    do {
+      y = std::bit_cast<float>(uint32_t(rng()));
+    } while (!std::isfinite(y));
+    floats.push_back(to_text(y));
+  }
+  auto integer_reference = []<typename T>(std::type_identity<T>) {
+    return [](const std::string& s) {
+      T value{};
+      std::from_chars(s.data(), s.data() + s.size(), value);
+      return value;
+    };
+  };
+  std::cout << "[+] Benchmark: columns of " << num << " numbers" << std::endl;
+  bool ok = true;
+  ok = benchmark<uint32_t>("uint32_t", u32, integer_reference(std::type_identity<uint32_t>{})) && ok;
+  ok = benchmark<int64_t>("int64_t", i64, integer_reference(std::type_identity<int64_t>{})) && ok;
+  ok = benchmark<double>("double, prices", prices_text,
+                         [](const std::string& s) { return std::strtod(s.c_str(), nullptr); }) &&
+       ok;
+  ok = benchmark<double>("double, shortest round trip", doubles,
+                         [](const std::string& s) { return std::strtod(s.c_str(), nullptr); }) &&
+       ok;
+  ok = benchmark<float>("float, shortest round trip", floats,
+                        [](const std::string& s) { return std::strtof(s.c_str(), nullptr); }) &&
+       ok;
+  std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the CPU has SSE4.1, the time varies by machine):
+
+[+] Usage
+42 -17 3.25 0.001 18446744073709551615
+prices: 19.99 0.5 1250
+int8_t of 300: result_out_of_range
+long double: from_chars
+[+] Benchmark: columns of 1000000 numbers
+uint32_t (swar): 1.05712 GB/s, from_chars: 0.719995 GB/s
+int64_t (sse4.1+swar): 0.97235 GB/s, from_chars: 0.682401 GB/s
+double, prices (eisel-lemire): 0.431894 GB/s, from_chars: 0.497937 GB/s
+double, shortest round trip (eisel-lemire): 0.5056 GB/s, from_chars: 0.467728 GB/s
+float, shortest round trip (eisel-lemire): 0.375541 GB/s, from_chars: 0.279517 GB/s
+OK
+
+NOTE:
+  The floating point std::from_chars of libstdc++ (since GCC 12) is already fast_float, i.e. Eisel-Lemire with the
+  Clinger fast path, so the floats are about the same speed: the gain is only the SWAR digits. It's strtod (or an
+  older libstdc++) which is several times slower. The integers win by the 8 (or 16) digits at once.
+*/
@@ -0,0 +1,316 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 11:21:06
+ *
+ * File Name: perfect_hash.cpp
+ * Description:
+ *
+ *  A perfect hash table built at compile time, for a fixed set of string keys (config keys, protocol commands, ...)
+ *  that are usually mapped by a std::unordered_map built at startup.
+ *
+ *  `make_perfect_hash_map<V>({{key, value}, ...})` runs the "hash and displace" construction in consteval: the keys
+ *  are grouped into buckets by one hash, and for each bucket (the largest first) a seed is searched such that the
+ *  second hash puts all of its keys into free slots. A lookup is then:
+ *
+ *    hash(key) -> seed of its bucket -> slot -> one key comparison
+ *
+ *  There's no runtime construction, and a duplicated key is a compile error.
+ *
+ */
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//
+// Perfect hash
+//
+
+// Little endian
+constexpr uint64_t load_u64(const char* data, size_t size) {
+  uint64_t value = 0;
+  if (std::is_constant_evaluated()) {
+    for (size_t i = 0; i < size; ++i) {
+      value |= uint64_t(static_cast<uint8_t>(data[i])) << (i * 8);
+    }
+  } else {
+    std::memcpy(&value, data, size);
+  }
+  return value;
+}
+
+// The first hash, 8 bytes per step
+constexpr uint64_t hash_key(std::string_view key) {
+  uint64_t hash = key.size() * 0x9e3779b97f4a7c15ull;
+  size_t i = 0;
+  for (; i + 8 <= key.size(); i += 8) {
+    hash = (hash ^ load_u64(key.data() + i, 8)) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 29;
+  }
+  if (i < key.size()) {
+    hash = (hash ^ load_u64(key.data() + i, key.size() - i)) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+// The second hash, seeded
+constexpr uint64_t mix(uint64_t hash, uint32_t seed) {
+  hash ^= seed * 0x9e3779b97f4a7c15ull;
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+template <typename V, size_t N>
+class perfect_hash_map {
+ public:
+  using entry = std::pair<std::string_view, V>;
+
+  static constexpr size_t num_slots = std::bit_ceil(N);
+  static constexpr size_t num_buckets = std::bit_ceil((N + 1) / 2);
+
+  consteval perfect_hash_map(const std::array<entry, N>& entries) {
+    std::array<uint64_t, N> hashes{};
+    for (size_t i = 0; i < N; ++i) {
+      hashes[i] = hash_key(entries[i].first);
+      for (size_t j = 0; j < i; ++j) {
+        if (entries[i].first == entries[j].first) {
+          throw "perfect_hash_map: duplicated key";
+        }
+      }
+    }
+    // The largest bucket first, when most of the slots are still free
+    std::array<size_t, num_buckets> bucket_sizes{};
+    for (auto hash : hashes) {
+      ++bucket_sizes[hash & (num_buckets - 1)];
+    }
+    std::array<size_t, num_buckets> buckets{};
+    for (size_t b = 0; b < num_buckets; ++b) {
+      buckets[b] = b;
+    }
+    std::sort(buckets.begin(), buckets.end(), [&](size_t a, size_t b) { return bucket_sizes[a] > bucket_sizes[b]; });
+    for (size_t bucket : buckets) {
+      if (bucket_sizes[bucket] == 0) {
+        break;
+      }
+      for (uint32_t seed = 1;; ++seed) {
+        if (seed > (1u << 20)) {
+          throw "perfect_hash_map: no seed is found";
+        }
+        if (try_place(entries, hashes, bucket, seed)) {
+          seeds_[bucket] = seed;
+          break;
+        }
+      }
+    }
+  }
+
+  constexpr const V* find(std::string_view key) const {
+    uint64_t hash = hash_key(key);
+    const auto& s = slots_[mix(hash, seeds_[hash & (num_buckets - 1)]) & (num_slots - 1)];
+    return s.used && s.key == key ? &s.value : nullptr;
+  }
+
+  static constexpr size_t size() { return N; }
+
+ private:
+  struct slot {
+    std::string_view key;
+    V value{};
+    bool used = false;
+  };
+
+  // Place the keys of the bucket with the seed, or nothing when any of them collides
+  constexpr bool try_place(const std::array<entry, N>& entries, const std::array<uint64_t, N>& hashes, size_t bucket,
+                           uint32_t seed) {
+    std::array<size_t, N> placed{};
+    size_t num_placed = 0;
+    for (size_t i = 0; i < N; ++i) {
+      if ((hashes[i] & (num_buckets - 1)) != bucket) {
+        continue;
+      }
+      size_t index = mix(hashes[i], seed) & (num_slots - 1);
+      bool collides = slots_[index].used;
+      for (size_t j = 0; j < num_placed && !collides; ++j) {
+        collides = placed[j] == index;
+      }
+      if (collides) {
+        return false;
+      }
+      placed[num_placed++] = index;
+    }
+    num_placed = 0;
+    for (size_t i = 0; i < N; ++i) {
+      if ((hashes[i] & (num_buckets - 1)) == bucket) {
+        slots_[placed[num_placed++]] = {entries[i].first, entries[i].second, true};
+      }
+    }
+    return true;
+  }
+
+  std::array<uint32_t, num_buckets> seeds_{};
+  std::array<slot, num_slots> slots_{};
+};
+
+template <typename V, size_t N>
+consteval auto make_perfect_hash_map(const std::pair<std::string_view, V> (&entries)[N]) {
+  return perfect_hash_map<V, N>(std::to_array(entries));
+}
+
+template <typename V, size_t N>
+consteval auto make_perfect_hash_map(const std::array<std::pair<std::string_view, V>, N>& entries) {
+  return perfect_hash_map<V, N>(entries);
+}
+
+//
+// Test
+//
+
+using handler = const char* (*)();
+
+constexpr auto commands = make_perfect_hash_map<handler>({
+    {"GET", [] { return "handle GET"; }},
+    {"SET", [] { return "handle SET"; }},
+    {"DEL", [] { return "handle DEL"; }},
+    {"PING", [] { return "handle PING"; }},
+});
+
+static_assert(commands.find("PING") != nullptr);
+static_assert(commands.find("QUIT") == nullptr);
+
+#define CONFIG_KEYS(X)                                                                                              \
+  X("server.listen.address") X("server.listen.port") X("server.listen.backlog") X("server.threads")                \
+  X("server.max_connections") X("server.idle_timeout_ms") X("server.read_timeout_ms") X("server.write_timeout_ms")  \
+  X("tls.enabled") X("tls.certificate") X("tls.private_key") X("tls.ciphers") X("tls.min_version")                  \
+  X("tls.session_cache_size") X("log.level") X("log.path") X("log.rotate_size") X("log.rotate_count")              \
+  X("log.format") X("metrics.enabled") X("metrics.port") X("metrics.path") X("metrics.interval_ms")                 \
+  X("cache.capacity") X("cache.ttl_ms") X("cache.shards") X("cache.eviction") X("storage.path")                     \
+  X("storage.sync") X("storage.block_size") X("storage.compression") X("storage.compaction.threads")               \
+  X("storage.compaction.trigger") X("storage.wal.enabled") X("storage.wal.path") X("storage.wal.segment_size")      \
+  X("auth.enabled") X("auth.provider") X("auth.token_ttl_ms") X("auth.issuer") X("rate_limit.enabled")              \
+  X("rate_limit.requests_per_second") X("rate_limit.burst") X("upstream.hosts") X("upstream.retries")               \
+  X("upstream.timeout_ms") X("upstream.keepalive") X("upstream.load_balancer")
+
+#define AS_KEY(key) key,
+
+constexpr std::string_view config_keys[] = {CONFIG_KEYS(AS_KEY)};
+constexpr size_t num_keys = std::size(config_keys);
+
+// The value of a key is its index
+constexpr auto config = make_perfect_hash_map([] {
+  std::array<std::pair<std::string_view, int>, num_keys> entries{};
+  for (size_t i = 0; i < num_keys; ++i) {
+    entries[i] = {config_keys[i], static_cast<int>(i)};
+  }
+  return entries;
+}());
+
+// Sorted at compile time for the binary search
+constexpr auto sorted_config = [] {
+  std::array<std::pair<std::string_view, int>, num_keys> result{};
+  for (size_t i = 0; i < num_keys; ++i) {
+    result[i] = {config_keys[i], static_cast<int>(i)};
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}();
+
+static_assert(*config.find("upstream.load_balancer") == num_keys - 1);
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  for (std::string_view name : {"SET", "PING", "QUIT"}) {
+    auto h = commands.find(name);
+    std::cout << name << ": " << (h ? (*h)() : "unknown command") << std::endl;
+  }
+  std::cout << "config: " << num_keys << " keys, " << decltype(config)::num_slots << " slots, "
+            << sizeof(config) << " bytes" << std::endl;
+  //
+  // Benchmark: lookups of random keys, 10% of them are missing
+  //
+  constexpr size_t num_lookups = 10000000;
+  std::vector<std::string> storage;
+  std::mt19937 rng(42);
+  for (size_t i = 0; i < 4096; ++i) {
+    std::string key(config_keys[rng() % num_keys]);
+    if (rng() % 10 == 0) {
+      key += ".missing";
+    }
+    storage.push_back(std::move(key));
+  }
+  std::vector<std::string_view> lookups(storage.begin(), storage.end());
+
+  std::unordered_map<std::string_view, int> map;
+  auto build_ns = measure([&] {
+    for (size_t i = 0; i < num_keys; ++i) {
+      map.emplace(config_keys[i], static_cast<int>(i));
+    }
+  });
+
+  long sum1 = 0, sum2 = 0, sum3 = 0;
+  auto perfect_ns = measure([&] {
+    for (size_t i = 0; i < num_lookups; ++i) {
+      auto value = config.find(lookups[i & 4095]);
+      sum1 += value ? *value : -1;
+    }
+  });
+  auto map_ns = measure([&] {
+    for (size_t i = 0; i < num_lookups; ++i) {
+      auto it = map.find(lookups[i & 4095]);
+      sum2 += it != map.end() ? it->second : -1;
+    }
+  });
+  auto binary_ns = measure([&] {
+    for (size_t i = 0; i < num_lookups; ++i) {
+      auto key = lookups[i & 4095];
+      auto it = std::lower_bound(sorted_config.begin(), sorted_config.end(), key,
+                                 [](const auto& entry, std::string_view k) { return entry.first < k; });
+      sum3 += it != sorted_config.end() && it->first == key ? it->second : -1;
+    }
+  });
+  std::cout << "[+] Benchmark: " << num_lookups << " lookups over " << num_keys << " keys (ns/lookup)" << std::endl;
+  std::cout << "perfect_hash_map: " << perfect_ns / num_lookups << " (built at compile time)" << std::endl;
+  std::cout << "std::unordered_map: " << map_ns / num_lookups << " (built in " << build_ns / 1000 << "us)"
+            << std::endl;
+  std::cout << "binary search: " << binary_ns / num_lookups << std::endl;
+  bool ok = sum1 == sum2 && sum2 == sum3;
+  std::cout << "sum:" << (ok ? "match" : "mismatch") << std::endl;
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+SET: handle SET
+PING: handle PING
+QUIT: unknown command
+config: 48 keys, 64 slots, 1664 bytes
+[+] Benchmark: 10000000 lookups over 48 keys (ns/lookup)
+perfect_hash_map: 26.6 (built at compile time)
+std::unordered_map: 27.0 (built in 16.6us)
+binary search: 77.8
+sum:match
+*/
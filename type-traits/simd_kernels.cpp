@@ -0,0 +1,516 @@
+/* Author: lipixun
+ * Created Time : 2026-10-19 16:05:13
+ *
+ * File Name: simd_kernels.cpp
+ * Description:
+ *
+ *  A real kernel library using the pattern of example1: sum, min/max, count, find and mismatch over contiguous
+ *  ranges. `if constexpr (HasOptimizedCodes<T>)` selects the vectorized kernels for integral and floating types,
+ *  other types go to the scalar ones.
+ *
+ *  The vectorized kernels use the vector extension of gcc, so one template covers all element types and vector widths.
+ *  Each kernel runs a scalar prologue until the data is aligned to the vector width, then the aligned vector loop, and
+ *  then a scalar tail for the rest.
+ *
+ *  The vector width is chosen at runtime as cpu_dispatch: the kernels are compiled twice, 32 bytes in functions with
+ *  target("avx2") and 16 bytes for the baseline (SSE2) of x86-64, and the function pointer is resolved once per kernel
+ *  and type. So the binary is built without -mavx2 and runs on any x86-64 host.
+ *
+ *  NOTE: The float sum adds in a different order from std::accumulate, so the last bits may differ. min/max of a
+ *  range with NaN is unspecified, the same as std::minmax_element.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// Vector types
+//
+
+// The 32 bytes vectors are only passed between always inlined functions, so the ABI of them without AVX doesn't matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+// Bytes: 16 for SSE2, 32 for AVX2
+template <typename T, size_t VectorWidth = 16>
+struct simd_traits {};
+
+template <typename T, size_t VectorWidth>
+  requires((std::integral<T> || std::floating_point<T>) && !std::same_as<T, bool> && sizeof(T) <= 8)
+struct simd_traits<T, VectorWidth> {
+  static constexpr size_t vector_width = VectorWidth;
+
+  typedef T vector __attribute__((vector_size(vector_width), __may_alias__));
+  // For loads which are only aligned to the element
+  typedef T unaligned_vector __attribute__((vector_size(vector_width), __may_alias__, aligned(alignof(T))));
+  // The result type of comparisons, a signed integer vector of the same lane width
+  using mask = decltype(std::declval<vector>() == std::declval<vector>());
+
+  static constexpr size_t lanes = vector_width / sizeof(T);
+
+  // All of the helpers and kernels are inlined into the entry points of each width, and compiled for their target
+  [[gnu::always_inline]] static vector load(const T* ptr) { return *reinterpret_cast<const vector*>(ptr); }
+
+  [[gnu::always_inline]] static vector loadu(const T* ptr) { return *reinterpret_cast<const unaligned_vector*>(ptr); }
+
+  [[gnu::always_inline]] static vector splat(T value) {
+    vector v;
+    for (size_t i = 0; i < lanes; ++i) {
+      v[i] = value;
+    }
+    return v;
+  }
+
+  [[gnu::always_inline]] static bool any(mask m) {
+    uint64_t b[vector_width / 8];
+    __builtin_memcpy(b, &m, sizeof(b));
+    uint64_t any = 0;
+    for (size_t i = 0; i < vector_width / 8; ++i) {
+      any |= b[i];
+    }
+    return any != 0;
+  }
+
+  // The number of elements before the first aligned one
+  [[gnu::always_inline]] static size_t head(const T* ptr, size_t size) {
+    auto misalign = reinterpret_cast<uintptr_t>(ptr) % vector_width;
+    return std::min(size, misalign ? (vector_width - misalign) / sizeof(T) : 0);
+  }
+};
+
+template <typename T>
+concept HasOptimizedCodes = requires { typename simd_traits<T>::vector; };
+
+//
+// Scalar kernels, for any type with the operators
+//
+
+struct scalar_kernels {
+  template <typename T>
+  static T sum(const T* data, size_t size, T init = T()) {
+    for (size_t i = 0; i < size; ++i) {
+      init = init + data[i];
+    }
+    return init;
+  }
+
+  // Requires size > 0
+  template <typename T>
+  static std::pair<T, T> min_max(const T* data, size_t size) {
+    T lo = data[0], hi = data[0];
+    for (size_t i = 1; i < size; ++i) {
+      if (data[i] < lo) {
+        lo = data[i];
+      }
+      if (hi < data[i]) {
+        hi = data[i];
+      }
+    }
+    return {lo, hi};
+  }
+
+  template <typename T>
+  static size_t count(const T* data, size_t size, const T& value) {
+    size_t n = 0;
+    for (size_t i = 0; i < size; ++i) {
+      n += data[i] == value;
+    }
+    return n;
+  }
+
+  template <typename T>
+  static size_t find(const T* data, size_t size, const T& value) {
+    for (size_t i = 0; i < size; ++i) {
+      if (data[i] == value) {
+        return i;
+      }
+    }
+    return size;
+  }
+
+  template <typename T>
+  static size_t mismatch(const T* a, const T* b, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+      if (!(a[i] == b[i])) {
+        return i;
+      }
+    }
+    return size;
+  }
+};
+
+//
+// Vectorized kernels
+//
+
+template <size_t VectorWidth>
+struct simd_kernels {
+  template <HasOptimizedCodes T>
+  [[gnu::always_inline]] static T sum(const T* data, size_t size) {
+    using simd = simd_traits<T, VectorWidth>;
+    auto head = simd::head(data, size);
+    T result = scalar_kernels::sum(data, head);
+    // Two accumulators to hide the latency of the adds
+    typename simd::vector acc0 = simd::splat(0), acc1 = simd::splat(0);
+    size_t i = head;
+    for (; i + 2 * simd::lanes <= size; i += 2 * simd::lanes) {
+      acc0 += simd::load(data + i);
+      acc1 += simd::load(data + i + simd::lanes);
+    }
+    acc0 += acc1;
+    for (size_t lane = 0; lane < simd::lanes; ++lane) {
+      result += acc0[lane];
+    }
+    return scalar_kernels::sum(data + i, size - i, result);
+  }
+
+  // Requires size > 0
+  template <HasOptimizedCodes T>
+  [[gnu::always_inline]] static std::pair<T, T> min_max(const T* data, size_t size) {
+    using simd = simd_traits<T, VectorWidth>;
+    auto head = simd::head(data, size);
+    if (size - head < simd::lanes) {
+      return scalar_kernels::min_max(data, size);
+    }
+    typename simd::vector lo = simd::load(data + head), hi = lo;
+    size_t i = head + simd::lanes;
+    for (; i + simd::lanes <= size; i += simd::lanes) {
+      auto v = simd::load(data + i);
+      lo = v < lo ? v : lo;
+      hi = hi < v ? v : hi;
+    }
+    std::pair<T, T> result{lo[0], hi[0]};
+    for (size_t lane = 1; lane < simd::lanes; ++lane) {
+      result.first = std::min(result.first, lo[lane]);
+      result.second = std::max(result.second, hi[lane]);
+    }
+    // The prologue and the tail
+    for (auto [begin, end] : {std::pair{size_t(0), head}, std::pair{i, size}}) {
+      if (begin < end) {
+        auto [l, h] = scalar_kernels::min_max(data + begin, end - begin);
+        result.first = std::min(result.first, l);
+        result.second = std::max(result.second, h);
+      }
+    }
+    return result;
+  }
+
+  template <HasOptimizedCodes T>
+  [[gnu::always_inline]] static size_t count(const T* data, size_t size, T value) {
+    using simd = simd_traits<T, VectorWidth>;
+    using lane_type = std::remove_cvref_t<decltype(std::declval<typename simd::mask>()[0])>;
+    auto head = simd::head(data, size);
+    size_t result = scalar_kernels::count(data, head, value);
+    auto needle = simd::splat(value);
+    size_t i = head;
+    while (i + simd::lanes <= size) {
+      // A matched lane is -1. Flush the lane counters before they overflow.
+      typename simd::mask counter{};
+      size_t blocks = std::min<size_t>((size - i) / simd::lanes, std::numeric_limits<lane_type>::max());
+      for (size_t block = 0; block < blocks; ++block, i += simd::lanes) {
+        counter -= simd::load(data + i) == needle;
+      }
+      for (size_t lane = 0; lane < simd::lanes; ++lane) {
+        result += static_cast<std::make_unsigned_t<lane_type>>(counter[lane]);
+      }
+    }
+    return result + scalar_kernels::count(data + i, size - i, value);
+  }
+
+  template <HasOptimizedCodes T>
+  [[gnu::always_inline]] static size_t find(const T* data, size_t size, T value) {
+    using simd = simd_traits<T, VectorWidth>;
+    auto head = simd::head(data, size);
+    if (auto pos = scalar_kernels::find(data, head, value); pos != head) {
+      return pos;
+    }
+    auto needle = simd::splat(value);
+    size_t i = head;
+    // Test 4 vectors at once, and locate the element only when there's a match
+    for (; i + 4 * simd::lanes <= size; i += 4 * simd::lanes) {
+      auto m0 = simd::load(data + i) == needle;
+      auto m1 = simd::load(data + i + simd::lanes) == needle;
+      auto m2 = simd::load(data + i + 2 * simd::lanes) == needle;
+      auto m3 = simd::load(data + i + 3 * simd::lanes) == needle;
+      if (simd::any((m0 | m1) | (m2 | m3))) {
+        return i + scalar_kernels::find(data + i, 4 * simd::lanes, value);
+      }
+    }
+    for (; i + simd::lanes <= size; i += simd::lanes) {
+      if (simd::any(simd::load(data + i) == needle)) {
+        return i + scalar_kernels::find(data + i, simd::lanes, value);
+      }
+    }
+    return i + scalar_kernels::find(data + i, size - i, value);
+  }
+
+  template <HasOptimizedCodes T>
+  [[gnu::always_inline]] static size_t mismatch(const T* a, const T* b, size_t size) {
+    using simd = simd_traits<T, VectorWidth>;
+    // Only one of them could be aligned
+    auto head = simd::head(a, size);
+    if (auto pos = scalar_kernels::mismatch(a, b, head); pos != head) {
+      return pos;
+    }
+    size_t i = head;
+    for (; i + simd::lanes <= size; i += simd::lanes) {
+      if (simd::any(simd::load(a + i) != simd::loadu(b + i))) {
+        return i + scalar_kernels::mismatch(a + i, b + i, simd::lanes);
+      }
+    }
+    return i + scalar_kernels::mismatch(a + i, b + i, size - i);
+  }
+};
+
+//
+// The entry points of each width
+//
+
+struct sse2_kernels {
+  template <typename T>
+  static T sum(const T* data, size_t size) { return simd_kernels<16>::sum(data, size); }
+
+  template <typename T>
+  static std::pair<T, T> min_max(const T* data, size_t size) { return simd_kernels<16>::min_max(data, size); }
+
+  template <typename T>
+  static size_t count(const T* data, size_t size, T value) { return simd_kernels<16>::count(data, size, value); }
+
+  template <typename T>
+  static size_t find(const T* data, size_t size, T value) { return simd_kernels<16>::find(data, size, value); }
+
+  template <typename T>
+  static size_t mismatch(const T* a, const T* b, size_t size) { return simd_kernels<16>::mismatch(a, b, size); }
+};
+
+struct avx2_kernels {
+  template <typename T>
+  __attribute__((target("avx2"))) static T sum(const T* data, size_t size) {
+    return simd_kernels<32>::sum(data, size);
+  }
+
+  template <typename T>
+  __attribute__((target("avx2"))) static std::pair<T, T> min_max(const T* data, size_t size) {
+    return simd_kernels<32>::min_max(data, size);
+  }
+
+  template <typename T>
+  __attribute__((target("avx2"))) static size_t count(const T* data, size_t size, T value) {
+    return simd_kernels<32>::count(data, size, value);
+  }
+
+  template <typename T>
+  __attribute__((target("avx2"))) static size_t find(const T* data, size_t size, T value) {
+    return simd_kernels<32>::find(data, size, value);
+  }
+
+  template <typename T>
+  __attribute__((target("avx2"))) static size_t mismatch(const T* a, const T* b, size_t size) {
+    return simd_kernels<32>::mismatch(a, b, size);
+  }
+};
+
+// Checks the OS support of the AVX registers as well
+bool cpu_has_avx2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2;
+}
+
+// Resolve the entry point of a kernel once, like an ifunc resolver
+#define SELECT_KERNEL(name, T) \
+  static const auto kernel = cpu_has_avx2() ? &avx2_kernels::name<T> : &sse2_kernels::name<T>
+
+//
+// The interface
+//
+
+struct algorithm_implementation {
+  template <typename T>
+  static T sum(std::span<const T> data) {
+    if constexpr (HasOptimizedCodes<T>) {
+      SELECT_KERNEL(sum, T);
+      return kernel(data.data(), data.size());
+    } else {
+      return scalar_kernels::sum(data.data(), data.size());
+    }
+  }
+
+  template <typename T>
+  static std::pair<T, T> min_max(std::span<const T> data) {
+    if constexpr (HasOptimizedCodes<T>) {
+      SELECT_KERNEL(min_max, T);
+      return kernel(data.data(), data.size());
+    } else {
+      return scalar_kernels::min_max(data.data(), data.size());
+    }
+  }
+
+  template <typename T>
+  static size_t count(std::span<const T> data, const T& value) {
+    if constexpr (HasOptimizedCodes<T>) {
+      SELECT_KERNEL(count, T);
+      return kernel(data.data(), data.size(), value);
+    } else {
+      return scalar_kernels::count(data.data(), data.size(), value);
+    }
+  }
+
+  template <typename T>
+  static size_t find(std::span<const T> data, const T& value) {
+    if constexpr (HasOptimizedCodes<T>) {
+      SELECT_KERNEL(find, T);
+      return kernel(data.data(), data.size(), value);
+    } else {
+      return scalar_kernels::find(data.data(), data.size(), value);
+    }
+  }
+
+  template <typename T>
+  static size_t mismatch(std::span<const T> a, std::span<const T> b) {
+    auto size = std::min(a.size(), b.size());
+    if constexpr (HasOptimizedCodes<T>) {
+      SELECT_KERNEL(mismatch, T);
+      return kernel(a.data(), b.data(), size);
+    } else {
+      return scalar_kernels::mismatch(a.data(), b.data(), size);
+    }
+  }
+};
+
+//
+// Test
+//
+
+// A type without vectorized kernels
+struct Money {
+  long cents;
+  Money operator+(const Money& other) const { return {cents + other.cents}; }
+  bool operator==(const Money& other) const = default;
+  bool operator<(const Money& other) const { return cents < other.cents; }
+};
+
+// Compare with the std algorithms at every offset and length around the vector width
+template <typename T>
+bool check() {
+  std::vector<T> buffer(300), other(300);
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    buffer[i] = other[i] = static_cast<T>(i % 13);
+  }
+  for (size_t offset = 0; offset < 40; ++offset) {
+    for (size_t size : {size_t(1), size_t(7), size_t(33), size_t(100), size_t(255)}) {
+      std::span<const T> data(buffer.data() + offset, size);
+      std::span<const T> data2(other.data() + offset / 2, size);
+      auto [lo, hi] = std::minmax_element(data.begin(), data.end());
+      size_t expected_count = std::count(data.begin(), data.end(), T(5));
+      size_t expected_find = std::find(data.begin(), data.end(), T(12)) - data.begin();
+      size_t expected_mismatch = std::mismatch(data.begin(), data.end(), data2.begin()).first - data.begin();
+      if (algorithm_implementation::sum(data) != std::accumulate(data.begin(), data.end(), T()) ||
+          algorithm_implementation::min_max(data) != std::pair{*lo, *hi} ||
+          algorithm_implementation::count(data, T(5)) != expected_count ||
+          algorithm_implementation::find(data, T(12)) != expected_find ||
+          algorithm_implementation::mismatch(data, data2) != expected_mismatch) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+//
+// Benchmark
+//
+
+template <typename F>
+double measure_gbps(size_t bytes, F&& f) {
+  // Repeat to touch at least 1GB in total
+  size_t rounds = std::max<size_t>(1, (size_t(1) << 30) / bytes);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < rounds; ++round) {
+    f();
+  }
+  auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return bytes * rounds / seconds / 1e9;
+}
+
+// Keep the result alive
+template <typename T>
+void keep(const T& value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+void benchmark(size_t bytes, const std::string& label) {
+  std::vector<int32_t> ints(bytes / sizeof(int32_t), 1);
+  std::vector<float> floats(bytes / sizeof(float), 1.0f);
+  std::vector<uint8_t> chars(bytes, 'a');
+  std::span<const int32_t> i32(ints);
+  std::span<const float> f32(floats);
+  std::span<const uint8_t> u8(chars);
+  std::cout << "[+] " << label << " (GB/s, std / kernel)" << std::endl;
+  std::cout << "sum int32: " << measure_gbps(bytes, [&] { keep(std::accumulate(i32.begin(), i32.end(), 0)); })
+            << " / " << measure_gbps(bytes, [&] { keep(algorithm_implementation::sum(i32)); }) << std::endl;
+  std::cout << "sum float: " << measure_gbps(bytes, [&] { keep(std::accumulate(f32.begin(), f32.end(), 0.0f)); })
+            << " / " << measure_gbps(bytes, [&] { keep(algorithm_implementation::sum(f32)); }) << std::endl;
+  std::cout << "min_max float: " << measure_gbps(bytes, [&] { keep(std::minmax_element(f32.begin(), f32.end())); })
+            << " / " << measure_gbps(bytes, [&] { keep(algorithm_implementation::min_max(f32)); }) << std::endl;
+  std::cout << "count uint8: " << measure_gbps(bytes, [&] { keep(std::count(u8.begin(), u8.end(), 'b')); }) << " / "
+            << measure_gbps(bytes, [&] { keep(algorithm_implementation::count(u8, uint8_t('b'))); }) << std::endl;
+  std::cout << "find int32: " << measure_gbps(bytes, [&] { keep(std::find(i32.begin(), i32.end(), 2)); }) << " / "
+            << measure_gbps(bytes, [&] { keep(algorithm_implementation::find(i32, 2)); }) << std::endl;
+  std::cout << "find uint8: " << measure_gbps(bytes, [&] { keep(std::find(u8.begin(), u8.end(), 'b')); }) << " / "
+            << measure_gbps(bytes, [&] { keep(algorithm_implementation::find(u8, uint8_t('b'))); }) << std::endl;
+}
+
+int main() {
+  bool ok = check<int8_t>() && check<uint8_t>() && check<int16_t>() && check<int32_t>() && check<uint64_t>() &&
+            check<float>() && check<double>();
+  std::cout << "check: " << (ok ? "OK" : "FAILED") << std::endl;
+
+  // Fall back to the scalar kernels
+  std::vector<Money> money{{100}, {250}, {50}};
+  auto [lo, hi] = algorithm_implementation::min_max<Money>(money);
+  std::cout << "Money: sum:" << algorithm_implementation::sum<Money>(money).cents << " min:" << lo.cents
+            << " max:" << hi.cents << std::endl;
+
+  benchmark(size_t(1) << 10, "1KB");
+  benchmark(size_t(1) << 20, "1MB");
+  benchmark(size_t(1) << 30, "1GB");
+  return ok ? 0 : 1;
+}
+
+/*
+Outputs (-O2, the AVX2 kernels are selected on this host, the numbers vary by machine):
+check: OK
+Money: sum:400 min:50 max:250
+[+] 1KB (GB/s, std / kernel)
+sum int32: 7.9 / 73.0
+sum float: 5.2 / 36.2
+min_max float: 2.1 / 20.4
+count uint8: 1.9 / 20.2
+find int32: 10.1 / 41.9
+find uint8: 2.7 / 34.8
+[+] 1MB (GB/s, std / kernel)
+sum int32: 8.1 / 96.4
+sum float: 5.3 / 67.9
+min_max float: 2.0 / 20.7
+count uint8: 1.9 / 30.6
+find int32: 9.6 / 39.7
+find uint8: 1.8 / 38.9
+[+] 1GB (GB/s, std / kernel)
+sum int32: 4.4 / 9.2
+sum float: 4.2 / 9.4
+min_max float: 1.8 / 8.1
+count uint8: 1.9 / 10.0
+find int32: 5.8 / 8.4
+find uint8: 2.7 / 8.8
+*/
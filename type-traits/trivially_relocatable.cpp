@@ -0,0 +1,443 @@
+/* Author: lipixun
+ * Created Time : 2026-10-20 10:02:48
+ *
+ * File Name: trivially_relocatable.cpp
+ * Description:
+ *
+ *  The opt-in pattern of example0 for relocation: moving an object to a new address and ending the lifetime of the
+ *  old one, in one step.
+ *
+ *  `trivially_relocatable<T>` is deduced for the trivially copyable types, and a type could opt in by specializing it
+ *  when its bytes could be moved as is (e.g. it only holds a std::unique_ptr). `small_vector<T, N>` (N elements
+ *  inline) and `fast_vector<T>` (no inline storage) then grow, insert and erase with memcpy / memmove instead of
+ *  move-construct + destroy per element.
+ *
+ *  NOTE: std::string of libstdc++ is not relocatable (the short string points into itself), so it takes the fallback:
+ *        the elements are shifted by move-assignment as std::vector.
+ *  The element type must be nothrow move constructible.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// The trait
+//
+
+template <typename T>
+struct trivially_relocatable : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template <typename T, typename D>
+struct trivially_relocatable<std::unique_ptr<T, D>> : trivially_relocatable<D> {};
+
+template <typename T>
+inline constexpr bool trivially_relocatable_v = trivially_relocatable<T>::value;
+
+// Move [src, src + n) to the uninitialized [dest, dest + n), and end the lifetime of the sources. No overlap.
+template <typename T>
+void relocate(T* src, size_t n, T* dest) noexcept {
+  if constexpr (trivially_relocatable_v<T>) {
+    if (n > 0) {
+      std::memcpy(static_cast<void*>(dest), static_cast<const void*>(src), n * sizeof(T));
+    }
+  } else {
+    for (size_t i = 0; i < n; ++i) {
+      std::construct_at(dest + i, std::move(src[i]));
+      std::destroy_at(src + i);
+    }
+  }
+}
+
+// Shift [first, last) right by one. `last` is uninitialized before, `first` is uninitialized after. The others are
+// moved by move-assignment as std::vector, only the new last one is constructed.
+template <typename T>
+void shift_right(T* first, T* last) noexcept {
+  if constexpr (trivially_relocatable_v<T>) {
+    std::memmove(static_cast<void*>(first + 1), static_cast<const void*>(first), (last - first) * sizeof(T));
+  } else if (first != last) {
+    std::construct_at(last, std::move(last[-1]));
+    std::move_backward(first, last - 1, last);
+    std::destroy_at(first);
+  }
+}
+
+// Remove `first` of [first, last) and shift the others left by one. `last - 1` is uninitialized after.
+template <typename T>
+void shift_left(T* first, T* last) noexcept {
+  if constexpr (trivially_relocatable_v<T>) {
+    std::destroy_at(first);
+    std::memmove(static_cast<void*>(first), static_cast<const void*>(first + 1), (last - first - 1) * sizeof(T));
+  } else {
+    std::move(first + 1, last, first);
+    std::destroy_at(last - 1);
+  }
+}
+
+//
+// Vectors
+//
+
+template <typename T, size_t N>
+struct inline_storage {
+  T* data() noexcept { return reinterpret_cast<T*>(bytes); }
+
+  alignas(T) std::byte bytes[N * sizeof(T)];
+};
+
+template <typename T>
+struct inline_storage<T, 0> {
+  T* data() noexcept { return nullptr; }
+};
+
+template <typename T, size_t N>
+class small_vector {
+  static_assert(std::is_nothrow_move_constructible_v<T>, "small_vector: T must be nothrow move constructible");
+
+ public:
+  // data_ is set in the body, inline_ is constructed after it
+  small_vector() noexcept : capacity_(N) { data_ = inline_.data(); }
+
+  small_vector(small_vector&& other) noexcept : small_vector() { steal(other); }
+
+  small_vector& operator=(small_vector&& other) noexcept {
+    if (this != &other) {
+      clear();
+      release();
+      data_ = inline_.data();
+      capacity_ = N;
+      steal(other);
+    }
+    return *this;
+  }
+
+  small_vector(const small_vector&) = delete;
+
+  ~small_vector() {
+    clear();
+    release();
+  }
+
+  size_t size() const noexcept { return size_; }
+
+  size_t capacity() const noexcept { return capacity_; }
+
+  bool empty() const noexcept { return size_ == 0; }
+
+  bool is_inline() const noexcept { return data_ == const_cast<small_vector*>(this)->inline_.data(); }
+
+  T* data() noexcept { return data_; }
+
+  T* begin() noexcept { return data_; }
+
+  T* end() noexcept { return data_ + size_; }
+
+  T& operator[](size_t index) noexcept { return data_[index]; }
+
+  const T& operator[](size_t index) const noexcept { return data_[index]; }
+
+  T& back() noexcept { return data_[size_ - 1]; }
+
+  void reserve(size_t n) {
+    if (n > capacity_) {
+      T* buffer = allocate(n);
+      relocate(data_, size_, buffer);
+      adopt(buffer, n);
+    }
+  }
+
+  template <typename... Args>
+  T& emplace_back(Args&&... args) {
+    if (size_ == capacity_) {
+      // Construct first, the arguments may refer to the current elements
+      size_t capacity = next_capacity();
+      T* buffer = allocate(capacity);
+      construct_or_deallocate(buffer, capacity, buffer + size_, std::forward<Args>(args)...);
+      relocate(data_, size_, buffer);
+      adopt(buffer, capacity);
+    } else {
+      std::construct_at(data_ + size_, std::forward<Args>(args)...);
+    }
+    return data_[size_++];
+  }
+
+  void push_back(const T& value) { emplace_back(value); }
+
+  void push_back(T&& value) { emplace_back(std::move(value)); }
+
+  T* insert(const T* pos, T value) {
+    size_t index = pos - data_;
+    if (size_ == capacity_) {
+      size_t capacity = next_capacity();
+      T* buffer = allocate(capacity);
+      construct_or_deallocate(buffer, capacity, buffer + index, std::move(value));
+      relocate(data_, index, buffer);
+      relocate(data_ + index, size_ - index, buffer + index + 1);
+      adopt(buffer, capacity);
+    } else {
+      shift_right(data_ + index, data_ + size_);
+      std::construct_at(data_ + index, std::move(value));
+    }
+    ++size_;
+    return data_ + index;
+  }
+
+  T* erase(const T* pos) noexcept {
+    size_t index = pos - data_;
+    shift_left(data_ + index, data_ + size_);
+    --size_;
+    return data_ + index;
+  }
+
+  void pop_back() noexcept { std::destroy_at(data_ + --size_); }
+
+  void clear() noexcept {
+    std::destroy(data_, data_ + size_);
+    size_ = 0;
+  }
+
+ private:
+  size_t next_capacity() const noexcept { return capacity_ == 0 ? 4 : capacity_ * 2; }
+
+  static T* allocate(size_t n) { return std::allocator<T>().allocate(n); }
+
+  // Construct an element in a new buffer, which is deallocated when the constructor throws
+  template <typename... Args>
+  static void construct_or_deallocate(T* buffer, size_t capacity, T* pos, Args&&... args) {
+    try {
+      std::construct_at(pos, std::forward<Args>(args)...);
+    } catch (...) {
+      std::allocator<T>().deallocate(buffer, capacity);
+      throw;
+    }
+  }
+
+  void release() noexcept {
+    if (!is_inline()) {
+      std::allocator<T>().deallocate(data_, capacity_);
+    }
+  }
+
+  // Take a new buffer, the elements are already relocated to it
+  void adopt(T* buffer, size_t capacity) noexcept {
+    release();
+    data_ = buffer;
+    capacity_ = capacity;
+  }
+
+  // This is empty and inline
+  void steal(small_vector& other) noexcept {
+    if (other.is_inline()) {
+      relocate(other.data_, other.size_, data_);
+    } else {
+      data_ = other.data_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_.data();
+      other.capacity_ = N;
+    }
+    size_ = other.size_;
+    other.size_ = 0;
+  }
+
+  T* data_;
+  size_t size_ = 0;
+  size_t capacity_;
+  [[no_unique_address]] inline_storage<T, N> inline_;
+};
+
+template <typename T>
+using fast_vector = small_vector<T, 0>;
+
+//
+// Test
+//
+
+// Opt in: only holds a std::unique_ptr, so the bytes could be moved
+struct Blob {
+  std::unique_ptr<char[]> data;
+  size_t size;
+};
+
+template <>
+struct trivially_relocatable<Blob> : std::true_type {};
+
+// Not relocatable: points into itself
+struct SelfRef {
+  SelfRef() : self(this) {}
+  SelfRef(SelfRef&&) noexcept : self(this) {}
+  SelfRef* self;
+};
+
+// The copy throws
+struct Fragile {
+  Fragile() = default;
+  Fragile(const Fragile&) { throw std::runtime_error("Fragile: copied"); }
+  Fragile(Fragile&&) noexcept = default;
+};
+
+static_assert(trivially_relocatable_v<int>);
+static_assert(trivially_relocatable_v<std::unique_ptr<int>>);
+static_assert(trivially_relocatable_v<Blob>);
+static_assert(!trivially_relocatable_v<std::string>);
+static_assert(!trivially_relocatable_v<SelfRef>);
+
+template <typename T>
+T make_payload(size_t i) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return "payload-" + std::to_string(i) + "-of-the-heap-allocated-string";
+  } else {
+    return std::make_unique<size_t>(i);
+  }
+}
+
+template <typename T>
+size_t payload_value(const T& value) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    return std::stoul(value.substr(8));
+  } else {
+    return *value;
+  }
+}
+
+template <typename F>
+double measure(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct workload_result {
+  double push_back_ms;
+  double insert_front_ms;
+  double erase_front_ms;
+  bool ok;
+};
+
+// The payloads are moved in from `src` and back, so the allocation of the payloads is not measured
+template <typename V, typename T>
+workload_result run_workloads(std::vector<T>& src, size_t num_inserts) {
+  workload_result result{};
+  result.ok = true;
+  {
+    V v;
+    result.push_back_ms = measure([&] {
+      for (auto& value : src) {
+        v.push_back(std::move(value));
+      }
+    });
+    for (size_t i = 0; i < src.size(); ++i) {
+      result.ok = result.ok && payload_value(v[i]) == i;
+      src[i] = std::move(v[i]);
+    }
+  }
+  {
+    V v;
+    result.insert_front_ms = measure([&] {
+      for (size_t i = 0; i < num_inserts; ++i) {
+        v.insert(v.begin(), std::move(src[i]));
+      }
+    });
+    for (size_t i = 0; i < num_inserts; ++i) {
+      result.ok = result.ok && payload_value(v[num_inserts - 1 - i]) == i;
+    }
+    result.erase_front_ms = measure([&] {
+      for (size_t i = num_inserts; i-- > 0;) {
+        src[i] = std::move(v[0]);
+        v.erase(v.begin());
+      }
+    });
+    result.ok = result.ok && v.size() == 0;
+  }
+  return result;
+}
+
+template <typename T>
+void run_benchmark(const char* name, size_t num, size_t num_inserts) {
+  std::vector<T> src;
+  src.reserve(num);
+  for (size_t i = 0; i < num; ++i) {
+    src.push_back(make_payload<T>(i));
+  }
+  std::cout << "[+] Benchmark: " << name << " (" << sizeof(T)
+            << " bytes, relocatable:" << trivially_relocatable_v<T> << "), push_back " << num
+            << " without reserve / insert " << num_inserts << " at front / erase them at front (ms)" << std::endl;
+  auto report = [](const char* container, const workload_result& r) {
+    std::cout << container << ": " << r.push_back_ms << " / " << r.insert_front_ms << " / " << r.erase_front_ms
+              << (r.ok ? "" : " MISMATCH") << std::endl;
+    return r.ok;
+  };
+  bool ok = report("std::vector", run_workloads<std::vector<T>>(src, num_inserts));
+  ok = report("fast_vector", run_workloads<fast_vector<T>>(src, num_inserts)) && ok;
+  ok = report("small_vector<16>", run_workloads<small_vector<T, 16>>(src, num_inserts)) && ok;
+  if (!ok) {
+    std::exit(1);
+  }
+}
+
+int main() {
+  //
+  // Usage
+  //
+  std::cout << "[+] Usage" << std::endl;
+  small_vector<Blob, 2> blobs;
+  for (size_t i = 0; i < 3; ++i) {
+    blobs.push_back(Blob{std::make_unique<char[]>(i + 1), i + 1});
+    std::cout << "size:" << blobs.size() << " inline:" << blobs.is_inline() << std::endl;
+  }
+  blobs.insert(blobs.begin(), Blob{std::make_unique<char[]>(10), 10});
+  blobs.erase(blobs.begin() + 1);
+  std::cout << "blob sizes:";
+  for (auto& blob : blobs) {
+    std::cout << " " << blob.size;
+  }
+  std::cout << std::endl;
+  small_vector<std::string, 4> names;
+  names.push_back("a short one");
+  names.push_back(std::string(64, 'x'));
+  auto moved = std::move(names);
+  std::cout << "moved: " << moved[0] << ", " << moved[1].size() << " chars, inline:" << moved.is_inline()
+            << std::endl;
+  // The new buffer is deallocated when the element throws while growing
+  small_vector<Fragile, 1> fragiles;
+  fragiles.emplace_back();
+  try {
+    fragiles.push_back(fragiles[0]);
+  } catch (const std::runtime_error& e) {
+    std::cout << "caught " << e.what() << ", size:" << fragiles.size() << " inline:" << fragiles.is_inline()
+              << std::endl;
+  }
+  //
+  // Benchmark
+  //
+  run_benchmark<std::unique_ptr<size_t>>("std::unique_ptr<size_t>", 1000000, 20000);
+  run_benchmark<std::string>("std::string", 1000000, 20000);
+  return 0;
+}
+
+/*
+Outputs (-O2, the time varies by machine):
+[+] Usage
+size:1 inline:1
+size:2 inline:1
+size:3 inline:0
+blob sizes: 10 2 3
+moved: a short one, 64 chars, inline:1
+caught Fragile: copied, size:1 inline:1
+[+] Benchmark: std::unique_ptr<size_t> (8 bytes, relocatable:1), push_back 1000000 without reserve / insert 20000 at front / erase them at front (ms)
+std::vector: 11.9 / 311.1 / 210.3
+fast_vector: 11.5 / 40.7 / 40.0
+small_vector<16>: 11.5 / 39.0 / 43.3
+[+] Benchmark: std::string (32 bytes, relocatable:0), push_back 1000000 without reserve / insert 20000 at front / erase them at front (ms)
+std::vector: 49.8 / 501.8 / 374.9
+fast_vector: 43.9 / 463.1 / 400.6
+small_vector<16>: 43.6 / 444.3 / 464.2
+*/